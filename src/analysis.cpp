@@ -0,0 +1,466 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * static passes over the abstract syntax tree
+ */
+
+#include "analysis.hpp"
+
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cache.hpp"
+#include "err.hpp"
+#include "runtime.hpp"
+
+namespace {
+
+struct EscapeState {
+    std::set<std::string> locals;
+    std::set<std::string> escaped;
+    // (holder, value): holder refers to the object stored in value
+    std::vector<std::pair<std::string, std::string>> aliases;
+    // (variable, call): call constructs the object stored in variable
+    std::vector<std::pair<std::string, AST::FuncCall *>> sites;
+};
+
+// name of the variable an expression evaluates to, "" otherwise
+std::string bare_name(AST::EvalExpr *e) {
+    if ((e == nullptr) || (!e->isVal))
+        return "";
+    auto v = e->val;
+    if (v->isConst || (v->call != nullptr) || (v->array != nullptr) ||
+        (v->refName.ClassName.size() != 0))
+        return "";
+    return v->refName.BaseName;
+}
+
+AST::FuncCall *bare_call(AST::EvalExpr *e) {
+    if ((e == nullptr) || (!e->isVal))
+        return nullptr;
+    auto v = e->val;
+    if (v->isConst || (v->array != nullptr))
+        return nullptr;
+    return v->call;
+}
+
+void collect(EscapeState *s, AST::EvalExpr *e);
+
+void collect(EscapeState *s, AST::ExprVal *v) {
+    if (v->isConst)
+        return;
+    if (v->call != nullptr) {
+        auto fn = v->call->function;
+        bool read_only = (fn.ClassName.size() == 0) &&
+            runtime_read_only(fn.BaseName);
+        for (auto&& par : v->call->pars) {
+            auto n = bare_name(par);
+            if ((n != "") && (!read_only))
+                s->escaped.insert(n);
+            collect(s, par);
+        }
+    }
+    if (v->array != nullptr)
+        collect(s, v->array);
+}
+
+void collect(EscapeState *s, AST::EvalExpr *e) {
+    if (e == nullptr)
+        return;
+    if (e->isVal) {
+        collect(s, e->val);
+        return;
+    }
+    if ((e->op == move) || (e->op == copy)) {
+        auto lhs = bare_name(e->l);
+        auto rhs = bare_name(e->r);
+        if (rhs != "") {
+            if (lhs != "")
+                s->aliases.push_back(std::make_pair(lhs, rhs));
+            else
+                s->escaped.insert(rhs);  // field or array element store
+        }
+        auto call = bare_call(e->r);
+        if ((lhs != "") && (call != nullptr))
+            s->sites.push_back(std::make_pair(lhs, call));
+    }
+    collect(s, e->l);
+    collect(s, e->r);
+}
+
+void collect(EscapeState *s, std::vector<AST::Expr *> *exprs) {
+    for (auto&& expr : *exprs) {
+        switch (expr->exprType) {
+            case AST::e_var: {
+                auto vd = static_cast<AST::VarDecl *>(expr);
+                auto n = vd->name.BaseName;
+                s->locals.insert(n);
+                auto rhs = bare_name(vd->init);
+                if (rhs != "")
+                    s->aliases.push_back(std::make_pair(n, rhs));
+                auto call = bare_call(vd->init);
+                if (call != nullptr)
+                    s->sites.push_back(std::make_pair(n, call));
+                collect(s, vd->init);
+                break;
+            }
+            case AST::e_eval: {
+                collect(s, static_cast<AST::EvalExpr *>(expr));
+                break;
+            }
+            case AST::e_if: {
+                auto ie = static_cast<AST::IfExpr *>(expr);
+                collect(s, ie->cond);
+                collect(s, &ie->iftrue);
+                collect(s, &ie->iffalse);
+                break;
+            }
+            case AST::e_while: {
+                auto we = static_cast<AST::WhileExpr *>(expr);
+                collect(s, we->cond);
+                collect(s, &we->exprs);
+                break;
+            }
+            case AST::e_for: {
+                auto fe = static_cast<AST::ForExpr *>(expr);
+                collect(s, fe->init);
+                collect(s, fe->cond);
+                collect(s, fe->step);
+                collect(s, &fe->exprs);
+                break;
+            }
+            case AST::e_match: {
+                auto me = static_cast<AST::MatchExpr *>(expr);
+                auto subject = bare_name(me->var);
+                for (auto&& line : me->lines) {
+                    if (line.cl_name == "")
+                        continue;
+                    s->locals.insert(line.cl_name);
+                    if (subject != "")
+                        s->aliases.push_back(std::make_pair(line.cl_name, subject));
+                }
+                collect(s, me->var);
+                for (auto&& line : me->lines)
+                    collect(s, &line.exprs);
+                break;
+            }
+            case AST::e_ret: {
+                auto re = static_cast<AST::RetExpr *>(expr);
+                auto n = bare_name(re->stmt);
+                if (n != "")
+                    s->escaped.insert(n);
+                collect(s, re->stmt);
+                break;
+            }
+            case AST::e_yield: {
+                auto ye = static_cast<AST::YieldExpr *>(expr);
+                auto n = bare_name(ye->stmt);
+                if (n != "")
+                    s->escaped.insert(n);
+                collect(s, ye->stmt);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+struct ParallelState {
+    AST::SymTable *st;
+    std::string index;
+    std::set<std::string> arrays;  // shared, written at the index
+    // shared variables read other than at the index
+    std::vector<std::pair<std::string, AST::ExprVal *>> reads;
+    std::set<AST::FuncDecl *> callees;  // checked, or being checked
+};
+
+// a stretch of code with its own variables: the loop body or a callee
+struct ParallelFrame {
+    std::set<std::string> locals;
+    bool body;  // the loop body, where the index is known
+    int loops = 0;  // nested inside it, for break
+};
+
+[[noreturn]] void parallel_error(const std::string &msg, ErrInfo *at) {
+    throw InterpreterException("parallel for: " + msg, at);
+}
+
+bool shared(ParallelFrame *f, const std::string &n) {
+    return f->locals.count(n) == 0;
+}
+
+void parallel_walk(ParallelState *s, ParallelFrame *f, std::vector<AST::Expr *> *exprs);
+void parallel_read(ParallelState *s, ParallelFrame *f, AST::EvalExpr *e);
+
+// binding a shared value to another name records the new name in the
+// value, which every iteration would do at once
+void parallel_bind(ParallelState *s, ParallelFrame *f, AST::EvalExpr *e, bool moved, ErrInfo *at) {
+    auto n = bare_name(e);
+    if ((n == "") || !shared(f, n))
+        return;
+    if (n != s->index)
+        parallel_error(n + " is shared by the iterations and cannot be bound to another name", at);
+    if (moved)
+        parallel_error("the index " + n + " cannot be moved", at);
+}
+
+void parallel_call(ParallelState *s, ParallelFrame *f, AST::FuncCall *call) {
+    auto& fn = call->function;
+    if ((fn.ClassName.size() != 0) || !shared(f, fn.BaseName))
+        parallel_error("cannot call " + fn.str() + ", only functions of the program", call);
+    for (auto&& par : call->pars) {
+        parallel_bind(s, f, par, false, call);
+        parallel_read(s, f, par);
+    }
+
+    AST::ValueType *vt;
+    try {
+        vt = s->st->lookup(fn, call)->get();
+    } catch (InterpreterException &) {
+        parallel_error("cannot call " + fn.str() + ", it is not declared", call);
+    }
+    if (vt->type.baseType == AST::t_builtin) {
+        if (!runtime_local(fn.BaseName))
+            parallel_error("cannot call " + fn.str() + ", it has effects outside the loop", call);
+        return;
+    }
+    if ((vt->type.baseType != AST::t_fn) || (vt->type.arrayT != 0))
+        parallel_error("cannot call " + fn.str() + ", only functions of the program", call);
+    auto fs = vt->data.fs;
+    if (fs->context.get() != nullptr)
+        parallel_error("cannot call the method " + fn.str(), call);
+    auto fd = fs->fd;
+    if (!s->callees.insert(fd).second)
+        return;
+    if (fd->body != 0)
+        std::call_once(fd->parsed, load_body, fd);
+
+    ParallelFrame callee;
+    callee.body = false;
+    for (auto&& prm : fd->pars)
+        callee.locals.insert(prm.name);
+    parallel_walk(s, &callee, &fd->exprs);
+}
+
+void parallel_read(ParallelState *s, ParallelFrame *f, AST::ExprVal *v) {
+    if (v->isConst)
+        return;
+    if (v->call != nullptr) {
+        parallel_call(s, f, v->call);
+        return;
+    }
+    if (v->refName.ClassName.size() != 0)
+        parallel_error("cannot use " + v->refName.str() + ", only plain variables", v);
+    auto n = v->refName.BaseName;
+    if (v->array != nullptr) {
+        parallel_read(s, f, v->array);
+        if (f->body && (bare_name(v->array) == s->index))
+            return;
+    }
+    if (shared(f, n) && (n != s->index))
+        s->reads.push_back(std::make_pair(n, v));
+}
+
+void parallel_read(ParallelState *s, ParallelFrame *f, AST::EvalExpr *e) {
+    if (e == nullptr)
+        return;
+    if (e->isVal) {
+        parallel_read(s, f, e->val);
+        return;
+    }
+    parallel_read(s, f, e->l);
+    parallel_read(s, f, e->r);
+}
+
+void parallel_write(ParallelState *s, ParallelFrame *f, AST::EvalExpr *e) {
+    if ((e->op != move) && (e->op != copy)) {
+        parallel_read(s, f, e);
+        return;
+    }
+    if (e->l->isVal) {
+        auto lv = e->l->val;
+        auto n = lv->refName.BaseName;
+        if ((lv->call != nullptr) || (lv->refName.ClassName.size() != 0))
+            parallel_error("cannot write " + lv->refName.str() + ", only plain variables", e);
+        if (lv->array != nullptr) {
+            parallel_read(s, f, lv->array);
+            if (shared(f, n)) {
+                if (!f->body || (bare_name(lv->array) != s->index))
+                    parallel_error("writes " + n + " other than at the index " + s->index, e);
+                s->arrays.insert(n);
+            }
+        } else if (n == s->index) {
+            parallel_error("the index " + n + " cannot be written", e);
+        } else if (shared(f, n)) {
+            parallel_error("writes " + n + ", which is shared by the iterations", e);
+        }
+    }
+    parallel_bind(s, f, e->r, e->op == move, e);
+    parallel_read(s, f, e->r);
+}
+
+void parallel_walk(ParallelState *s, ParallelFrame *f, std::vector<AST::Expr *> *exprs) {
+    for (auto&& expr : *exprs) {
+        switch (expr->exprType) {
+            case AST::e_var: {
+                auto vd = static_cast<AST::VarDecl *>(expr);
+                parallel_bind(s, f, vd->init, false, vd);
+                parallel_read(s, f, vd->init);
+                f->locals.insert(vd->name.BaseName);
+                break;
+            }
+            case AST::e_eval: {
+                parallel_write(s, f, static_cast<AST::EvalExpr *>(expr));
+                break;
+            }
+            case AST::e_if: {
+                auto ie = static_cast<AST::IfExpr *>(expr);
+                parallel_read(s, f, ie->cond);
+                parallel_walk(s, f, &ie->iftrue);
+                parallel_walk(s, f, &ie->iffalse);
+                break;
+            }
+            case AST::e_while: {
+                auto we = static_cast<AST::WhileExpr *>(expr);
+                parallel_read(s, f, we->cond);
+                f->loops++;
+                parallel_walk(s, f, &we->exprs);
+                f->loops--;
+                break;
+            }
+            case AST::e_for: {
+                auto fe = static_cast<AST::ForExpr *>(expr);
+                parallel_write(s, f, fe->init);
+                parallel_read(s, f, fe->cond);
+                parallel_write(s, f, fe->step);
+                f->loops++;
+                parallel_walk(s, f, &fe->exprs);
+                f->loops--;
+                break;
+            }
+            case AST::e_match: {
+                auto me = static_cast<AST::MatchExpr *>(expr);
+                parallel_bind(s, f, me->var, false, me);
+                parallel_read(s, f, me->var);
+                for (auto&& line : me->lines) {
+                    if (line.cl_name != "")
+                        f->locals.insert(line.cl_name);
+                    parallel_walk(s, f, &line.exprs);
+                }
+                break;
+            }
+            case AST::e_ret: {
+                auto re = static_cast<AST::RetExpr *>(expr);
+                if (f->body)
+                    parallel_error("an iteration cannot return", re);
+                parallel_bind(s, f, re->stmt, true, re);
+                parallel_read(s, f, re->stmt);
+                break;
+            }
+            case AST::e_yield: {
+                auto ye = static_cast<AST::YieldExpr *>(expr);
+                if (f->body)
+                    parallel_error("an iteration cannot yield", ye);
+                parallel_bind(s, f, ye->stmt, true, ye);
+                parallel_read(s, f, ye->stmt);
+                break;
+            }
+            case AST::e_break: {
+                if (f->body && (f->loops == 0))
+                    parallel_error("an iteration cannot break the loop",
+                        static_cast<AST::BreakExpr *>(expr));
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+}  // namespace
+
+void escape_analysis(AST::FuncDecl *fd) {
+    EscapeState s;
+    for (auto&& prm : fd->pars)
+        s.locals.insert(prm.name);
+    collect(&s, &fd->exprs);
+
+    // anything stored outside the frame escapes, and so does everything
+    // it was aliased with
+    for (auto&& alias : s.aliases)
+        if (s.locals.count(alias.first) == 0)
+            s.escaped.insert(alias.second);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto&& alias : s.aliases) {
+            if ((s.escaped.count(alias.first) != 0) &&
+                (s.escaped.count(alias.second) == 0)) {
+                s.escaped.insert(alias.second);
+                changed = true;
+            }
+        }
+    }
+
+    for (auto&& site : s.sites) {
+        site.second->in_frame = (s.locals.count(site.first) != 0) &&
+            (s.escaped.count(site.first) == 0);
+    }
+}
+
+void analyze(AST::Program *prog) {
+    for (auto&& stmt : prog->stmts) {
+        switch (stmt->stmtType) {
+            case AST::gs_func: {
+                escape_analysis(static_cast<AST::FuncDecl *>(stmt));
+                break;
+            }
+            case AST::gs_class: {
+                auto cl = static_cast<AST::ClassDecl *>(stmt);
+                for (auto&& clstmt : cl->stmts)
+                    if (clstmt->stmtType == AST::gs_func)
+                        escape_analysis(static_cast<AST::FuncDecl *>(clstmt));
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+void parallel_check(AST::ForExpr *fe, AST::SymTable *st) {
+    // (i = a; i < b; i = i + 1), or i <= b
+    auto init = fe->init, cond = fe->cond, step = fe->step;
+    std::string index;
+    if ((init != nullptr) && !init->isVal && ((init->op == move) || (init->op == copy)))
+        index = bare_name(init->l);
+    bool ok = (index != "") && (cond != nullptr) && !cond->isVal &&
+        ((cond->op == lt) || (cond->op == le)) && (bare_name(cond->l) == index) &&
+        (step != nullptr) && !step->isVal && (step->op == move) &&
+        (bare_name(step->l) == index) && !step->r->isVal && (step->r->op == add) &&
+        (bare_name(step->r->l) == index) && step->r->r->isVal &&
+        step->r->r->val->isConst && (step->r->r->val->constVal == "1");
+    if (!ok)
+        parallel_error("the loop must count up by one, as (i = a; i < b; i = i + 1)", fe);
+
+    ParallelState s;
+    s.st = st;
+    s.index = index;
+    ParallelFrame body;
+    body.body = true;
+    // the bounds are evaluated once, before the iterations start
+    parallel_walk(&s, &body, &fe->exprs);
+    for (auto&& read : s.reads)
+        if (s.arrays.count(read.first) != 0)
+            parallel_error("reads " + read.first + " other than at the index " + index, read.second);
+
+    fe->index = AST::Name(index);
+    fe->arrays.clear();
+    for (auto&& n : s.arrays)
+        fe->arrays.push_back(AST::Name(n));
+}
@@ -0,0 +1,21 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#pragma once
+
+#include "ast.hpp"
+
+// escape analysis: marks constructor calls whose object never leaves the
+// function creating it, so the runtime may place it in frame storage
+extern void escape_analysis(AST::FuncDecl *fd);
+
+// shows the iterations of a parallel for independent: the body writes
+// only its own variables and shared arrays at the index, and calls only
+// functions of the program (checked alike) or builtins without effects.
+// Callees are resolved in `st`, so this runs before the first iteration.
+extern void parallel_check(AST::ForExpr *fe, AST::SymTable *st);
+
+// runs every static pass over a freshly parsed program
+extern void analyze(AST::Program *prog);
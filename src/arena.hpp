@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * bump allocator owning every node of one parsed module
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace AST {
+
+// Nodes are carved out of large blocks in the order the parser finishes
+// them. Children are completed before their parent, so every expression
+// subtree ends up in one contiguous run of memory. Nothing is freed on its
+// own - the whole arena goes away with the Program owning it.
+class Arena {
+ private:
+    static constexpr size_t block_size = 64 * 1024;
+
+    struct Dtor {
+        void *obj;
+        void (*fn)(void *);
+    };
+
+    std::vector<char *> blocks;
+    std::vector<Dtor> dtors;
+    char *cur = nullptr;
+    char *end = nullptr;
+
+    void *allocate(size_t size, size_t align) {
+        auto p = reinterpret_cast<uintptr_t>(cur);
+        auto aligned = (p + align - 1) & ~(uintptr_t)(align - 1);
+        if ((cur == nullptr) || (aligned + size > reinterpret_cast<uintptr_t>(end))) {
+            size_t n = (size + align > block_size) ? (size + align) : block_size;
+            cur = static_cast<char *>(std::malloc(n));
+            if (cur == nullptr)
+                throw std::bad_alloc();
+            blocks.push_back(cur);
+            end = cur + n;
+            p = reinterpret_cast<uintptr_t>(cur);
+            aligned = (p + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        cur = reinterpret_cast<char *>(aligned + size);
+        return reinterpret_cast<void *>(aligned);
+    }
+
+ public:
+    Arena() {}
+    Arena(const Arena &) = delete;
+    Arena& operator= (const Arena &) = delete;
+
+    ~Arena() {
+        for (auto it = dtors.rbegin(); it != dtors.rend(); ++it)
+            it->fn(it->obj);
+        for (auto block : blocks)
+            std::free(block);
+    }
+
+    template<typename T, typename... Args>
+    T *make(Args&&... args) {
+        void *mem = allocate(sizeof(T), alignof(T));
+        T *obj = new (mem) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value)
+            dtors.push_back(Dtor{obj, [](void *o) { static_cast<T *>(o)->~T(); }});
+        return obj;
+    }
+
+    size_t bytes(void) const {
+        return blocks.size() * block_size;
+    }
+};
+
+}  // namespace AST
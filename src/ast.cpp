@@ -11,6 +11,9 @@
 #include "util.hpp"
 #include "runtime.hpp"
 #include "err.hpp"
+#include "cache.hpp"
+#include "link.hpp"
+#include "parallel.hpp"
 
 using namespace AST;
 
@@ -24,13 +27,13 @@ void MemStore::Free(void) {
             if (v->ms.size() != 0) {
                 v = nullptr;
             } else {
-                if (!placehold) {
+                if ((!placehold) && (!v->inFrame)) {
                     delete v;
                 }
             }
             return;
         }
-    if ((v->ms.size() == 0) && (!placehold)) {
+    if ((v->ms.size() == 0) && (!placehold) && (!v->inFrame)) {
         delete v;
     }
 }
@@ -40,7 +43,11 @@ void MemStore::set(ValueType *vt) {
     v = vt;
 }
 
-ValueType *MemStore::get(void) {
+void MemStore::relocate(ValueType *vt) {
+    v = vt;
+}
+
+ValueType *MemStore::get(void) const {
     return v;
 }
 
@@ -60,29 +67,74 @@ FuncStore::~FuncStore() {
 }
 
 // Symble Table - record Variable and Type Information
+SymTable::SymTable(const SymTable *outer, size_t layers, bool constants) : borrowed(layers) {
+    for (size_t i = 0; i < layers; ++i) {
+        if (!constants) {
+            d.push_back(outer->d[i]);
+            continue;
+        }
+        d.push_back(std::map<Name, MemStore>());
+        for (auto&& it : outer->d[i]) {
+            auto vt = it.second.get();
+            if ((vt != nullptr) && vt->isConst)
+                d.back().insert(it);
+        }
+    }
+}
+
 void SymTable::addLayer(void) {
     d.push_back(std::map<Name, MemStore>());
 }
 
-void SymTable::removeLayer(void) {
+void SymTable::removeLayer(ValueType *keep) {
     for (auto&& ms : d.back()) {
+        if ((keep != nullptr) && (ms.second.get() == keep)) {
+            // detach the value returned to the caller instead of freeing it
+            ms.second.placehold = true;
+        }
         ms.second.Free();
     }
     d.pop_back();
 }
 
+void SymTable::rebind(SymTable *old) {
+    for (auto&& layer : d) {
+        for (auto&& ms : layer) {
+            auto vt = ms.second.get();
+            if ((vt == nullptr) || (vt->type.baseType != t_fn) || (vt->type.arrayT != 0))
+                continue;
+            auto context = vt->data.fs->context.get();
+            if ((context != nullptr) && (context->data.st == old))
+                context->data.st = this;
+        }
+    }
+}
+
 SymTable::~SymTable() {
-    while (!this->d.empty())
+    while (this->d.size() > this->borrowed)
         this->removeLayer();
 }
 
-MemStore SymTable::insert(Name name, ValueType *vt) {
-    if (name.str() == "this") {
-        d.back()[name].placehold = true;
+MemStore SymTable::insert(const Name &name, ValueType *vt) {
+    auto& ms = d.back()[name];
+    if (name.ClassName.empty() && (name.BaseName == "this")) {
+        ms.placehold = true;
+    }
+    vt->ms.push_back(&ms);
+    ms.set(vt);
+    return ms;
+}
+
+void SymTable::defer(std::string name, GlobalStatement *gs) {
+    deferred[name] = gs;
+}
+
+void SymTable::undefer(void) {
+    while (!deferred.empty()) {
+        auto gs = deferred.begin()->second;
+        deferred.erase(deferred.begin());
+        gs->declare(this, nullptr);
     }
-    vt->ms.push_back(& d.back()[name]);
-    d.back()[name].set(vt);
-    return d.back()[name];
 }
 
 MemStore SymTable::update(ExprVal *name, ValueType *vt) {
@@ -92,7 +144,7 @@ MemStore SymTable::update(ExprVal *name, ValueType *vt) {
     return *ms;
 }
 
-MemStore *SymTable::lookup(Name name, ErrInfo* ast) {
+MemStore *SymTable::lookup(const Name &name, ErrInfo* ast) {
     if (name.ClassName.size() > 0) {
         auto owner = this->lookup(name.owner(), ast)->get();
         if (!((owner->type.baseType) == t_rtfn && (name.BaseName == "new"))) {
@@ -111,8 +163,19 @@ MemStore *SymTable::lookup(Name name, ErrInfo* ast) {
     }
 
     for (int i = d.size() - 1; i >= 0; i--) {
-        if (d[i].find(name) != d[i].end()) {
-            return & d[i][name];
+        auto it = d[i].find(name);
+        if (it != d[i].end()) {
+            return &it->second;
+        }
+    }
+    if (!deferred.empty()) {
+        // a class also declares its constructor, as Class.new
+        auto it = deferred.find(name.ClassName.empty() ? name.BaseName : name.ClassName[0]);
+        if (it != deferred.end()) {
+            auto gs = it->second;
+            deferred.erase(it);
+            gs->declare(this, nullptr);
+            return this->lookup(name, ast);
         }
     }
     throw InterpreterException("variable " + name.str() + " is not declared", ast);
@@ -122,8 +185,9 @@ MemStore *SymTable::lookup(ExprVal *name) {
     if (name->call != nullptr)
         throw InterpreterException("cannot lookup a function call", name);
 
+    auto ms = name->linked;
     if (name->array != nullptr) {
-        auto arr = this->lookup(name->refName, name)->get();
+        auto arr = ((ms != nullptr) ? ms : this->lookup(name->refName, name))->get();
         auto arr_index_vt = name->array->interpret(this);
         if (arr_index_vt->type != IntType) {
             throw InterpreterException("array index must be an int", name);
@@ -137,8 +201,76 @@ MemStore *SymTable::lookup(ExprVal *name) {
         auto vts = arr->data.vt;
         return &vts[arr_index];
     } else {
-        return this->lookup(name->refName, name);
+        return (ms != nullptr) ? ms : this->lookup(name->refName, name);
+    }
+}
+
+// Frame Storage - placement of non-escaping objects
+void FrameStack::enter(void) {
+    bases.push_back(top);
+}
+
+ValueType *FrameStack::leave(ValueType *ret) {
+    for (size_t i = bases.back(); i < top; ++i) {
+        auto s = slots[i].get();
+        if (!s->used)
+            continue;
+        if ((s->vt()->ms.size() != 0) || (s->vt() == ret)) {
+            // references the analysis cannot see (callees resolving the
+            // name dynamically, methods storing `this`) move it to the heap
+            auto moved = promote(s);
+            if (s->vt() == ret)
+                ret = moved;
+        }
+        destroy(s);
+    }
+    top = bases.back();
+    bases.pop_back();
+    return ret;
+}
+
+ValueType *FrameStack::newObject(bool in_frame, TypeDecl *t) {
+    if ((!in_frame) || bases.empty())
+        return new ValueType(new SymTable(), t);
+
+    Slot *slot = nullptr;
+    for (size_t i = bases.back(); i < top; ++i) {
+        auto s = slots[i].get();
+        if (s->used && (s->vt()->ms.size() == 0))
+            destroy(s);
+        if (!s->used) {
+            slot = s;
+            break;
+        }
+    }
+    if (slot == nullptr) {
+        if (top == slots.size())
+            slots.push_back(std::make_unique<Slot>());
+        slot = slots[top++].get();
     }
+
+    auto vt = new (slot->value) ValueType(new (slot->table) SymTable(), t);
+    vt->inFrame = true;
+    slot->used = true;
+    return vt;
+}
+
+ValueType *FrameStack::promote(Slot *s) {
+    auto old = s->vt();
+    auto st = new SymTable(std::move(*s->st()));
+    st->rebind(s->st());
+    auto vt = new ValueType(st, &old->type, old->isConst);
+    vt->ms = std::move(old->ms);
+    old->ms.clear();
+    for (auto&& msi : vt->ms)
+        msi->relocate(vt);
+    return vt;
+}
+
+void FrameStack::destroy(Slot *s) {
+    s->vt()->~ValueType();
+    s->st()->~SymTable();
+    s->used = false;
 }
 
 /**
@@ -168,7 +300,25 @@ ValueType *ConstEval(ExprVal *e) {
     }
 }
 
-std::string TypeDecl::str(void) {
+ExprVal::ExprVal(ErrInfo at, std::string v, TypeDecl t) :
+    ErrInfo(at), isConst(true), constVal(v), type(t) {
+    switch (t.baseType) {
+        case t_int32:
+        case t_char:
+        case t_fp32:
+        case t_fp64:
+            try {
+                this->folded.reset(ConstEval(this));
+            } catch (std::exception &) {
+                // left to ConstEval() to report when it is evaluated
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+std::string TypeDecl::str(void) const {
     std::stringstream ss;
     switch (this->baseType) {
         case t_bool:
@@ -200,6 +350,15 @@ std::string TypeDecl::str(void) {
             if (enum_base != "")
                 ss << "::" << enum_base;
             break;
+        case t_chan:
+            ss << "chan";
+            break;
+        case t_future:
+            ss << "future";
+            break;
+        case t_generator:
+            ss << "generator";
+            break;
         case t_enumfn:
             ss << "enum initialzer";
         default:
@@ -229,51 +388,301 @@ ValueType *TypeDecl::newVal(void) {
                 return new ValueType((float)0.0, false);
             case t_fp64:
                 return new ValueType(0.0, false);
+            case t_chan: {
+                auto vt = new ValueType((SymTable*)nullptr, this);
+                vt->data.chan = new Channel();
+                return vt;
+            }
             default:
                 return new ValueType((SymTable*)nullptr, this);
         }
     } else {
         ValueType* arr = new ValueType(this, false);
         auto td = new TypeDecl(this->baseType);
+        if ((this->baseType == t_chan) || (this->baseType == t_future) ||
+            (this->baseType == t_generator))
+            td->gen = this->gen;
         for (int i = 0; i < this->arrayT; ++i) {
-            arr->data.vt[i].set(td->newVal());
+            // recorded like any stored value, so reading it does not free it
+            auto vt = td->newVal();
+            vt->ms.push_back(&arr->data.vt[i]);
+            arr->data.vt[i].set(vt);
         }
         delete td;
         return arr;
     }
 }
 
-static int return_flag = 0;
-static int continue_flag = 0;
-static int break_flag = 0;
+thread_local Interpreter *Interpreter::active = nullptr;
+
+Interpreter::~Interpreter() {
+    this->unload();
+}
+
+void Interpreter::load(Program prog) {
+    // threads of the program loaded before end with it
+    this->join(true);
+    this->spawn_error = nullptr;
+    Scope scope(this);
+    if (this->resident && (this->root != nullptr) && !runtime_stale(prog.imports)) {
+        // keep the builtins and modules in the bottom layer
+        while (this->root->depth() > 1)
+            this->root->removeLayer();
+        this->program.reset();
+    } else {
+        this->unload();
+        this->root = new SymTable();
+        this->root->addLayer();
+        runtime_bind(this->root);
+    }
+    this->program = std::make_unique<Program>(std::move(prog));
+    this->program->load(this->root);
+    this->shared = std::make_unique<SymTable>(this->root, this->root->depth(), true);
+}
+
+ValueType *Interpreter::call(const std::string &name, std::vector<ValueType *> args) {
+    Scope scope(this);
+    if (this->root == nullptr)
+        throw InterpreterException("no program is loaded", nullptr);
+
+    Name fn_name;
+    size_t begin = 0, dot;
+    while ((dot = name.find('.', begin)) != std::string::npos) {
+        fn_name.ClassName.push_back(name.substr(begin, dot - begin));
+        begin = dot + 1;
+    }
+    fn_name.BaseName = name.substr(begin);
 
-int AST::interpret(Program prog) {
-    SymTable *st = new SymTable();
+    std::string error;
+    auto fn_ = this->root->lookup(fn_name, nullptr)->get();
+    FuncDecl *fd = nullptr;
+    if (fn_->type.baseType != t_fn) {
+        error = name + " is not a function";
+    } else {
+        fd = fn_->data.fs->fd;
+        if (args.size() != fd->pars.size())
+            error = err_par_size_mismatch(name, fd->pars.size(), args.size());
+        for (size_t i = 0; error.empty() && (i < args.size()); ++i)
+            if (args[i]->type != fd->pars[i].type)
+                error = err_type_mismatch(
+                    fd->pars[i].name, args[i]->type.str(), fd->pars[i].type.str());
+    }
+    if (!error.empty()) {
+        for (auto&& vt : args)
+            if (vt->ms.size() == 0)
+                delete vt;
+        throw InterpreterException(error, nullptr);
+    }
+
+    auto layers = this->root->depth();
+    auto frame_depth = this->frames.depth();
+    auto st = this->root;
     st->addLayer();
-    runtime_bind(st);
-    prog.interpret(st);
-    st->removeLayer();
-    delete st;
+    for (size_t i = 0; i < args.size(); ++i)
+        st->insert(fd->slots[i], args[i]);
+    auto fn = fn_->data.fs;
+    if (fn->context.get() != nullptr)
+        st->insert(Name("this"), fn->context.get());
+
+    try {
+        this->frames.enter();
+        auto ret = fd->interpret(st);
+        st->removeLayer(ret);
+        ret = this->frames.leave(ret);
+        async_drain(this);
+        return ret;
+    } catch (...) {
+        // drop what the failed call left behind, the program stays usable
+        async_cancel(this);
+        while (st->depth() > layers)
+            st->removeLayer();
+        while (this->frames.depth() > frame_depth)
+            this->frames.leave(nullptr);
+        this->return_flag = this->continue_flag = this->break_flag = 0;
+        throw;
+    }
+}
+
+void Interpreter::unload(void) {
+    if (this->root == nullptr)
+        return;
+    this->join(true);
+    this->spawn_error = nullptr;
+    Scope scope(this);
+    this->shared.reset();
+    delete this->root;
+    this->root = nullptr;
+    // the module tables went with the root table
+    if (this->reuse_modules) {
+        for (auto&& it : this->imports) {
+            auto& file = this->module_files[it.first];
+            this->spare[file.first] = {file.second, std::move(it.second)};
+        }
+    }
+    this->module_tables.clear();
+    this->module_files.clear();
+    this->imports.clear();
+    this->program.reset();
+}
+
+int Interpreter::run(Program prog) {
+    this->load(std::move(prog));
+    auto ret = this->call("main", {});
+    if ((ret->ms.size() == 0) && (ret != & None))
+        delete ret;
+    this->join(false);
+    if (this->spawn_error) {
+        auto error = this->spawn_error;
+        this->spawn_error = nullptr;
+        std::rethrow_exception(error);
+    }
+    if (!this->resident)
+        this->unload();
 
     return 0;
 }
 
+void Interpreter::hold(void) {
+    std::lock_guard<std::mutex> guard(this->spawn_lock);
+    // nothing declares itself on first use once threads share the modules
+    for (auto&& it : this->module_tables)
+        it.second->undefer();
+    this->spawned++;
+}
+
+Task *Interpreter::spawn(FuncDecl *fd, std::vector<ValueType *> args) {
+    auto top = this->owner;
+    top->hold();
+    auto t = new Task(top, fd, std::move(args));
+    Task::submit(t);
+    return t;
+}
+
+ValueType *Interpreter::execute(FuncDecl *fd, std::vector<ValueType *> args) {
+    auto st = this->bind(fd, std::move(args));
+    return this->invoke(fd, st.get());
+}
+
+std::unique_ptr<SymTable> Interpreter::bind(FuncDecl *fd, std::vector<ValueType *> args) {
+    auto st = std::make_unique<SymTable>(this->shared.get(), this->shared->depth());
+    st->addLayer();
+    for (size_t i = 0; i < args.size(); ++i)
+        st->insert(fd->slots[i], args[i]);
+    return st;
+}
+
+ValueType *Interpreter::invoke(FuncDecl *fd, SymTable *st, Coroutine *co) {
+    Interpreter in;
+    in.owner = this;
+    in.out = this->out;
+    in.coroutine = co;
+    Scope scope(&in);
+    ValueType *ret;
+    try {
+        in.frames.enter();
+        ret = fd->interpret(st);
+        st->removeLayer(ret);
+        ret = in.frames.leave(ret);
+        async_drain(&in);
+    } catch (...) {
+        async_cancel(&in);
+        while (in.frames.depth() > 0)
+            in.frames.leave(nullptr);
+        throw;
+    }
+    if ((ret->ms.size() == 0) || (ret == & None))
+        return ret;
+    // a constant of the program, or an argument the caller still holds:
+    // it gets a copy of its own
+    switch (ret->type.arrayT == 0 ? ret->type.baseType : t_void) {
+        case t_bool: case t_char: case t_uint8:
+        case t_int32: case t_fp32: case t_fp64: {
+            auto copy = new ValueType(*ret);
+            copy->ms.clear();
+            copy->isConst = false;
+            copy->inFrame = false;
+            return copy;
+        }
+        case t_str:
+            return new ValueType(new std::string(*ret->data.str), false);
+        default:
+            throw InterpreterException(fd->name.str() + " cannot return " +
+                ret->type.str() + " shared with the program to another thread", fd);
+    }
+}
+
+void Interpreter::finish(std::exception_ptr error) {
+    std::lock_guard<std::mutex> guard(this->spawn_lock);
+    if (error && !this->spawn_error) {
+        this->spawn_error = error;
+        // whoever waits on a channel for this call would wait forever
+        this->stopping = true;
+    }
+    if (--this->spawned == 0)
+        this->spawn_done.notify_all();
+}
+
+std::exception_ptr Interpreter::spawned_error(void) {
+    std::lock_guard<std::mutex> guard(this->spawn_lock);
+    return this->spawn_error;
+}
+
+void Interpreter::join(bool stop) {
+    if (stop)
+        this->stopping = true;
+    std::unique_lock<std::mutex> guard(this->spawn_lock);
+    // calls still running may spawn more meanwhile
+    this->spawn_done.wait(guard, [this] { return this->spawned == 0; });
+    this->stopping = false;
+}
+
 void Program::declare(SymTable *st) {
     for (auto stmt = stmts.begin(); stmt != stmts.end(); stmt++) {
         (*stmt)->declare(st, nullptr);
     }
 }
 
-INTERPRET(Program) {
-    st->addLayer();
+void Program::defer(SymTable *st) {
+    for (auto&& stmt : stmts) {
+        switch (stmt->stmtType) {
+            case gs_var:
+                // initializers may have effects, keep them in order
+                stmt->declare(st, nullptr);
+                break;
+            case gs_func:
+                st->defer(static_cast<FuncDecl *>(stmt)->name.BaseName, stmt);
+                break;
+            case gs_class:
+                st->defer(static_cast<ClassDecl *>(stmt)->name.BaseName, stmt);
+                break;
+            case gs_union:
+                st->defer(static_cast<UnionDecl *>(stmt)->name.BaseName, stmt);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void Program::load(SymTable *st) {
     runtime_imports(this->imports, st);
-    this->declare(st);
-    auto fs = st->lookup(Name("main"), this)->get()->data.fs;
     st->addLayer();
-    fs->fd->interpret(st);
-    st->removeLayer();
-    st->removeLayer();
-    return & None;
+    this->declare(st);
+    link_program(this);
+}
+
+static void release(EvalExpr *e, ValueType *vt) {
+    if ((vt->ms.size() != 0) || (vt == & None))
+        return;
+    if (e->isVal && (vt == e->val->folded.get()))
+        return;
+    delete vt;
+}
+
+// the value of a statement, which nobody reads
+static void discard(Expr *e, ValueType *vt) {
+    if ((e->exprType == e_eval) && (vt != nullptr) && !vt->inFrame)
+        release(static_cast<EvalExpr *>(e), vt);
 }
 
 INTERPRET(VarDecl) {
@@ -321,12 +730,16 @@ void FuncDecl::declare(SymTable *st, SymTable *context) {
 }
 
 INTERPRET(FuncDecl) {
+    auto in = Interpreter::current();
+    if (this->body != 0)
+        std::call_once(this->parsed, load_body, this);
     for (auto&& e : this->exprs) {
         ValueType *vt = e->interpret(st);
-        if (return_flag) {
-            return_flag--;
+        if (in->return_flag) {
+            in->return_flag--;
             return vt;
         }
+        discard(e, vt);
     }
     return & None;
 }
@@ -334,10 +747,15 @@ INTERPRET(FuncDecl) {
 INTERPRET(FuncCall) {
     st->addLayer();
 
-    auto fn_ = st->lookup(this->function, this)->get();
+    auto ms = this->linked;
+    auto fn_ = ((ms != nullptr) ? ms : st->lookup(this->function, this))->get();
+    if (fn_->type.baseType == t_builtin) {
+        st->removeLayer();
+        return runtime_builtin(fn_->data.ival, this, st);
+    }
     if (fn_->type.baseType == t_rtfn) {
         st->removeLayer();
-        return runtime_handler(this->function, this, st);
+        return runtime_construct(fn_->data.cd, this, st);
     }
     if (fn_->type.baseType == t_enumfn) {
         st->removeLayer();
@@ -346,37 +764,76 @@ INTERPRET(FuncCall) {
     if (fn_->type.baseType != t_fn)
         throw InterpreterException("type cannot be called", this);
 
-    auto fn = fn_->data.fs;
+    auto fd = fn_->data.fs->fd;
+    if (this->pars.size() != fd->pars.size()) {
+        throw InterpreterException(err_par_size_mismatch(
+            this->function.str(), fd->pars.size(), this->pars.size()
+        ), this);
+    }
+    // a yield in the body makes a generator
+    if (fd->body != 0)
+        std::call_once(fd->parsed, load_body, fd);
+    bool resumable = fd->generator || fd->is_async;
+    if (resumable && (fn_->data.fs->context.get() != nullptr))
+        throw InterpreterException(fd->name.str() + ": a method cannot be a generator or async", this);
+    if (fd->generator && fd->is_async)
+        throw InterpreterException(fd->name.str() + ": an async function cannot yield", this);
+    std::vector<ValueType *> args;
 
     for (unsigned int i = 0; i < this->pars.size(); ++i) {
         auto vt = this->pars[i]->interpret(st);
-        auto prm = fn->fd->pars[i];
-
-        // replace generic symbols
-        auto ty = prm.type;
-        if (ty.baseType == AST::t_class) {
-            if (ty.other.str() == fn->fd->genType.name.str()) {
-                ty.other = this->gen_val;
-            } else if (ty.gen.name.str() == fn->fd->genType.name.str()) {
-                ty.gen.name = this->gen_val;
-            }
+        auto& prm = fd->pars[i];
+
+        // replace generic symbols, the declared type is used as it is
+        // unless that changes it
+        const TypeDecl *ty = &prm.type;
+        TypeDecl replaced(t_void);
+        if ((fd->generic[i] == FuncDecl::gen_other) && !(ty->other == this->gen_val)) {
+            replaced = prm.type;
+            replaced.other = this->gen_val;
+            ty = &replaced;
+        } else if ((fd->generic[i] == FuncDecl::gen_param) && !(ty->gen.name == this->gen_val)) {
+            replaced = prm.type;
+            replaced.gen.name = this->gen_val;
+            ty = &replaced;
         }
-        if (vt->type != ty) {
+        if (vt->type != *ty) {
             throw InterpreterException(err_type_mismatch(
-                prm.name, vt->type.str(), ty.str()
+                prm.name, vt->type.str(), ty->str()
             ), this);
         }
-        st->insert(Name(prm.name), vt);
+        if (resumable)
+            args.push_back(vt);
+        else
+            st->insert(fd->slots[i], vt);
     }
 
+    if (resumable) {
+        // the body runs as a coroutine, which sees the arguments the
+        // caller passed as any call does
+        st->removeLayer();
+        auto type = TypeDecl(*this, fd->is_async ? t_future : t_generator, Name(),
+            GenericDecl(*this, Name(fd->ret.str())), 0);
+        auto vt = new ValueType((SymTable *)nullptr, &type);
+        if (fd->is_async)
+            vt->data.task = async_call(fd, std::move(args));
+        else
+            vt->data.generator = Generator::call(fd, std::move(args));
+        return vt;
+    }
+
+    auto fn = fn_->data.fs;
     if (fn->context.get() != nullptr) {
-        st->insert(Name("this"), fn->context.get());
+        static const Name self("this");
+        st->insert(self, fn->context.get());
     }
 
+    auto in = Interpreter::current();
+    in->frames.enter();
     auto ret = fn->fd->interpret(st);
-    st->removeLayer();
+    st->removeLayer(ret);
 
-    return ret;
+    return in->frames.leave(ret);
 }
 
 // runtime helper function to create initializer
@@ -385,7 +842,7 @@ void ClassDecl::declare(SymTable *st, SymTable *context) {
     for (auto&& stmt : this->stmts) {
         switch (stmt->stmtType) {
             case gs_func: {
-                auto fd = (FuncDecl *)stmt.get();
+                auto fd = (FuncDecl *)stmt;
                 if (fd->name.BaseName == "new") {
                     st->insert(Name(& this->name, "new"), new ValueType(new FuncStore(fd, nullptr, VoidType), true));
                 }
@@ -402,11 +859,11 @@ void UnionDecl::declare(SymTable *st, SymTable *context) {
     unst->addLayer();
     for (auto&& cl : this->classes) {
         cl->gen = this->gen;
-        unst->insert(Name(cl->name.BaseName), new ValueType(cl.get(), true));
+        unst->insert(Name(cl->name.BaseName), new ValueType(cl, true));
     }
     auto unty = AST::TypeDecl(AST::t_class);
     unty.other = this->name;
-    st->insert(this->name, new ValueType(unst, &unty));
+    st->insert(this->name, new ValueType(unst, &unty, true));
 }
 
 bool vt_is_true(ValueType *vt, ErrInfo *ast) {
@@ -417,20 +874,124 @@ bool vt_is_true(ValueType *vt, ErrInfo *ast) {
         throw InterpreterException("expression is not boolean", ast);
     }
     bool result = vt->data.one_bit;
-    delete vt;
+    if (vt->ms.size() == 0)
+        delete vt;
+    return result;
+}
+
+template <typename T>
+static bool compare(token op, const T &l, const T &r) {
+    switch (op) {
+        case equ: return l == r;
+        case neq: return l != r;
+        case lt: return l < r;
+        case le: return l <= r;
+        case gt: return l > r;
+        default: return l >= r;
+    }
+}
+
+// variables are read where they are stored, numeric constants come folded
+static ValueType *operand(EvalExpr *e, SymTable *st) {
+    if (e->isVal && (e->val->folded != nullptr))
+        return e->val->folded.get();
+    return e->interpret(st);
+}
+
+// operands of && and ||
+static bool truth(ValueType *vt, EvalExpr *e) {
+    if (vt->type.arrayT != 0)
+        throw InterpreterException(terms[e->op] + " cannot operate on " + vt->type.str(), e);
+    switch (vt->type.baseType) {
+        case t_bool:
+            return vt->data.one_bit;
+        case t_uint8:
+            return vt->data.bval;
+        case t_int32:
+            return vt->data.ival;
+        case t_fp32:
+            return vt->data.fval;
+        case t_fp64:
+            return vt->data.dval;
+        default:
+            throw InterpreterException(terms[e->op] + " cannot operate on " + vt->type.str(), e);
+    }
+}
+
+bool EvalExpr::test(SymTable *st, ErrInfo *at) {
+    if (this->isVal)
+        return vt_is_true(this->val->interpret(st), at);
+    switch (this->op) {
+        case equ:
+        case neq:
+        case lt:
+        case le:
+        case gt:
+        case ge:
+            break;
+        case land:
+            if (this->logical)
+                return this->l->test(st, at) && this->r->test(st, at);
+            return vt_is_true(this->interpret(st), at);
+        case lor:
+            if (this->logical)
+                return this->l->test(st, at) || this->r->test(st, at);
+            return vt_is_true(this->interpret(st), at);
+        default:
+            return vt_is_true(this->interpret(st), at);
+    }
+
+    auto lvt = operand(this->l, st);
+    auto rvt = operand(this->r, st);
+    if ((lvt->type.arrayT != 0) || (rvt->type.arrayT != 0))
+        throw InterpreterException(terms[this->op] + " cannot operate on " + lvt->type.str(), this);
+    if (lvt->type != rvt->type)
+        throw InterpreterException(err_type_mismatch(
+            "", lvt->type.str(), rvt->type.str()), this);
+
+    bool ordered = (this->op != equ) && (this->op != neq);
+    bool result;
+    switch (lvt->type.baseType) {
+        case t_uint8:
+            result = compare(this->op, lvt->data.bval, rvt->data.bval);
+            break;
+        case t_int32:
+            result = compare(this->op, lvt->data.ival, rvt->data.ival);
+            break;
+        case t_fp32:
+            result = compare(this->op, lvt->data.fval, rvt->data.fval);
+            break;
+        case t_fp64:
+            result = compare(this->op, lvt->data.dval, rvt->data.dval);
+            break;
+        case t_char:
+            if (ordered)
+                throw InterpreterException(terms[this->op] + " cannot operate on " + lvt->type.str(), this);
+            result = compare(this->op, lvt->data.cval, rvt->data.cval);
+            break;
+        case t_str:
+            if (ordered)
+                throw InterpreterException(terms[this->op] + " cannot operate on " + lvt->type.str(), this);
+            result = compare(this->op, *lvt->data.str, *rvt->data.str);
+            break;
+        default:
+            throw InterpreterException(terms[this->op] + " cannot operate on " + lvt->type.str(), this);
+    }
+    release(this->l, lvt);
+    release(this->r, rvt);
     return result;
 }
 
 INTERPRET(IfExpr) {
     st->addLayer();
-    auto cond_vt = this->cond->interpret(st);
-    if (vt_is_true(cond_vt, this)) {
+    if (this->cond->test(st, this)) {
         for (auto&& expr : this->iftrue) {
             auto ret = expr->interpret(st);
             if (expr->exprType == e_ret) {
                 st->removeLayer();
                 return ret;
             }
+            discard(expr, ret);
         }
     } else {
         for (auto&& expr : this->iffalse) {
@@ -439,6 +1000,7 @@ INTERPRET(IfExpr) {
                 st->removeLayer();
                 return ret;
             }
+            discard(expr, ret);
         }
     }
     st->removeLayer();
@@ -446,48 +1008,50 @@ INTERPRET(IfExpr) {
 }
 
 INTERPRET(ForExpr) {
+    if (this->parallel)
+        return run_parallel(this, st);
+    auto in = Interpreter::current();
     st->addLayer();
     this->init->interpret(st);
-    auto cond_vt = this->cond->interpret(st);
-    while (vt_is_true(cond_vt, this)) {
+    while (this->cond->test(st, this)) {
         for (auto&& expr : this->exprs) {
             auto ret = expr->interpret(st);
-            if (return_flag) {
+            if (in->return_flag) {
                 st->removeLayer();
                 return ret;
             }
-            if (continue_flag || break_flag) {
+            discard(expr, ret);
+            if (in->continue_flag || in->break_flag) {
                 break;
             }
         }
-        if (break_flag) {
+        if (in->break_flag) {
             break;
         }
         this->step->interpret(st);
-        cond_vt = this->cond->interpret(st);
     }
     st->removeLayer();
     return & None;
 }
 
 INTERPRET(WhileExpr) {
+    auto in = Interpreter::current();
     st->addLayer();
-    auto cond_vt = this->cond->interpret(st);
-    while (vt_is_true(cond_vt, this)) {
+    while (this->cond->test(st, this)) {
         for (auto&& expr : this->exprs) {
             auto ret = expr->interpret(st);
-            if (return_flag) {
+            if (in->return_flag) {
                 st->removeLayer();
                 return ret;
             }
-            if (continue_flag || break_flag) {
+            discard(expr, ret);
+            if (in->continue_flag || in->break_flag) {
                 break;
             }
         }
-        if (break_flag) {
+        if (in->break_flag) {
             break;
         }
-        cond_vt = this->cond->interpret(st);
     }
     st->removeLayer();
     return & None;
@@ -507,23 +1071,32 @@ INTERPRET(ExprVal) {
 }
 
 INTERPRET(RetExpr) {
-    return_flag++;
-    if (this->stmt == nullptr)
-        return & None;
-    return this->stmt->interpret(st);
+    // raised once the value is there, calls made for it return on their own
+    auto vt = (this->stmt == nullptr) ? & None : this->stmt->interpret(st);
+    Interpreter::current()->return_flag++;
+    return vt;
+}
+
+INTERPRET(YieldExpr) {
+    auto vt = this->stmt->interpret(st);
+    Generator::yield(vt, this);
+    return & None;
 }
 
 INTERPRET(ContExpr) {
-    continue_flag++;
+    auto in = Interpreter::current();
+    in->continue_flag++;
     return nullptr;
 }
 
 INTERPRET(BreakExpr) {
-    break_flag++;
+    auto in = Interpreter::current();
+    in->break_flag++;
     return nullptr;
 }
 
 INTERPRET(MatchExpr) {
+    auto in = Interpreter::current();
     auto vt = this->var->interpret(st);
     if ((vt->type.baseType != t_class) || (vt->type.enum_base == "")) {
         throw InterpreterException(
@@ -537,10 +1110,11 @@ INTERPRET(MatchExpr) {
             st->insert(Name(l.cl_name), vt);
             for (auto&& e : l.exprs) {
                 auto ret = e->interpret(st);
-                if (return_flag || break_flag || continue_flag) {
+                if (in->return_flag || in->break_flag || in->continue_flag) {
                     st->removeLayer();
                     return ret;
                 }
+                discard(e, ret);
             }
             st->removeLayer();
             break;
@@ -561,7 +1135,7 @@ INTERPRET(EvalExpr) {
     if ((this->op == move) || (this->op == copy)) {
         if (!this->l->isVal)
             throw InterpreterException("lvalue is not a variable", this);
-        auto lvt = st->lookup(this->l->val.get())->get();
+        auto lvt = st->lookup(this->l->val)->get();
         if (lvt->isConst)
             throw InterpreterException("constant cannot be assigned", this);
         auto rvt = this->r->interpret(st);
@@ -578,15 +1152,33 @@ INTERPRET(EvalExpr) {
             }
             rvt->ms.clear();
             rvt->isConst = false;
-            st->update(this->l->val.get(), rvt);
+            st->update(this->l->val, rvt);
             return & None;
         }
         if (this->op == copy) {
-            st->update(this->l->val.get(), rvt);
+            st->update(this->l->val, rvt);
             return & None;
         }
     }
 
+    if ((this->op == land) || (this->op == lor)) {
+        // the right operand only runs when the left one leaves it open
+        auto lvt = this->l->interpret(st);
+        bool result = truth(lvt, this);
+        if (result == (this->op == lor)) {
+            release(this->l, lvt);
+            return new ValueType(result);
+        }
+        auto rvt = this->r->interpret(st);
+        if (lvt->type != rvt->type)
+            throw InterpreterException(err_type_mismatch(
+                "", lvt->type.str(), rvt->type.str()), this);
+        result = truth(rvt, this);
+        release(this->l, lvt);
+        release(this->r, rvt);
+        return new ValueType(result);
+    }
+
     auto lvt = this->l->interpret(st);
     auto rvt = this->r->interpret(st);
     if ((lvt->type.arrayT != 0) || (rvt->type.arrayT != 0))
@@ -795,34 +1387,6 @@ INTERPRET(EvalExpr) {
                 throw InterpreterException(terms[this->op] + " cannot operate on " + lvt->type.str(), this);
         }
     }
-    case land: {
-        switch (lvt->type.baseType) {
-            case t_uint8:
-                return new ValueType((bool)(lvt->data.bval && rvt->data.bval));
-            case t_int32:
-                return new ValueType((bool)(lvt->data.ival && rvt->data.ival));
-            case t_fp32:
-                return new ValueType((bool)(lvt->data.fval && rvt->data.fval));
-            case t_fp64:
-                return new ValueType((bool)(lvt->data.dval && rvt->data.dval));
-            default:
-                throw InterpreterException(terms[this->op] + " cannot operate on " + lvt->type.str(), this);
-        }
-    }
-    case lor: {
-        switch (lvt->type.baseType) {
-            case t_uint8:
-                return new ValueType((bool)(lvt->data.bval || rvt->data.bval));
-            case t_int32:
-                return new ValueType((bool)(lvt->data.ival || rvt->data.ival));
-            case t_fp32:
-                return new ValueType((bool)(lvt->data.fval || rvt->data.fval));
-            case t_fp64:
-                return new ValueType((bool)(lvt->data.dval || rvt->data.dval));
-            default:
-                throw InterpreterException(terms[this->op] + " cannot operate on " + lvt->type.str(), this);
-        }
-    }
     default:
         throw InterpreterException("unhandled operator " + terms[this->op], this);
     }
@@ -11,11 +11,20 @@
 #include <iostream>
 #include <sstream>
 #include <memory>
+#include <mutex>
 #include <utility>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
 
+#include "arena.hpp"
+#include "channel.hpp"
+#include "coroutine.hpp"
 #include "err.hpp"
+#include "generator.hpp"
 #include "scanner.hpp"
+#include "task.hpp"
 
 // Error Logging
 #define LogError(e) std::cerr << "AST Error: " << e << std::endl
@@ -41,6 +50,7 @@ class MatchLine;
 class Param;
 class Program;
 class RetExpr;
+class YieldExpr;
 class WhileExpr;
 class VarDecl;
 class ValueType;
@@ -63,21 +73,36 @@ class MemStore {
 
     void Free(void);
     void set(ValueType *v);
-    ValueType *get(void);
+    void relocate(ValueType *v);
+    ValueType *get(void) const;
 };
 
 class SymTable {
  private:
     std::vector<std::map<Name, MemStore>> d;
+    // members declared by the first lookup that needs them
+    std::map<std::string, GlobalStatement *> deferred;
+    size_t borrowed = 0;
 
  public:
+    SymTable() {}
+    // reads and writes through the bottom `layers` of `outer`, which keeps
+    // owning their values; layers added on top are its own. With
+    // `constants`, only bindings that cannot be reassigned are taken.
+    SymTable(const SymTable *outer, size_t layers, bool constants = false);
+    SymTable(SymTable&&) = default;
     ~SymTable();
     void addLayer(void);
-    void removeLayer(void);
-    MemStore insert(Name name, ValueType *vt);
+    void removeLayer(ValueType *keep = nullptr);
+    void rebind(SymTable *old);
+    MemStore insert(const Name &name, ValueType *vt);
+    void defer(std::string name, GlobalStatement *gs);
     MemStore update(ExprVal *name, ValueType *vt);
-    MemStore *lookup(Name name, ErrInfo *ast);
+    MemStore *lookup(const Name &name, ErrInfo *ast);
     MemStore *lookup(ExprVal *name);
+    size_t depth(void) const { return d.size(); }
+    // declares what is left to the first lookup
+    void undefer(void);
 };
 
 // Runtime Information
@@ -104,7 +129,7 @@ class Name {
         return ss.str();
     }
 
-    Name owner(void) {
+    Name owner(void) const {
         Name parent(this->ClassName.back());
         for (int i = 0; i < (int)this->ClassName.size() - 1; ++i) {
             parent.ClassName.push_back(this->ClassName[i]);
@@ -146,12 +171,13 @@ class GenericDecl : public ErrInfo {
     Name name;
 
     GenericDecl() : valid(false) {}
-    GenericDecl(scanner *Scanner, Name n) : ErrInfo(Scanner), valid(true), name(n) {}
+    GenericDecl(ErrInfo at, Name n) : ErrInfo(at), valid(true), name(n) {}
 };
 
 enum Types {
     t_void, t_int32, t_uint8, t_fp32, t_fp64, t_char, t_str, t_class, t_fn,
-    t_bool, t_rtfn, t_enumfn, t_type /* runtime function */
+    t_bool, t_rtfn, t_enumfn, t_type, t_builtin /* runtime function */,
+    t_chan, t_future, t_generator
 };
 
 class TypeDecl : public ErrInfo {
@@ -164,7 +190,7 @@ class TypeDecl : public ErrInfo {
     GenericDecl gen;
 
     friend bool operator==(const TypeDecl& lhs, const TypeDecl& rhs) {
-        if ((lhs.gen.valid != rhs.gen.valid) || (lhs.gen.name.str() != rhs.gen.name.str()))  // TODO: modify BaseName to check 
+        if ((lhs.gen.valid != rhs.gen.valid) || (!(lhs.gen.name == rhs.gen.name)))  // TODO: modify BaseName to check 
             return false;
         if (lhs.baseType == t_class) {
             return (lhs.baseType == rhs.baseType) && (lhs.other.BaseName == rhs.other.BaseName);
@@ -187,14 +213,14 @@ class TypeDecl : public ErrInfo {
         this->baseType = t_class;
     }
 
-    TypeDecl(scanner *Scanner, Types t, Name o, GenericDecl g, int i) :
-        ErrInfo(Scanner), baseType(t), arrayT(i), other(o), gen(g) {
-        if ((t != t_class) && (g.valid))
+    TypeDecl(ErrInfo at, Types t, Name o, GenericDecl g, int i) :
+        ErrInfo(at), baseType(t), arrayT(i), other(o), gen(g) {
+        if ((t != t_class) && (t != t_chan) && (t != t_future) && (t != t_generator) && (g.valid))
             throw std::runtime_error("no generic is possible");
     }
 
     ValueType *newVal(void);
-    std::string str(void);
+    std::string str(void) const;
 };
 static TypeDecl VoidType = TypeDecl(t_void);
 static TypeDecl BoolType = TypeDecl(t_bool);
@@ -203,6 +229,7 @@ static TypeDecl IntType  = TypeDecl(t_int32);
 static TypeDecl FloatType = TypeDecl(t_fp32);
 static TypeDecl DoubleType = TypeDecl(t_fp64);
 static TypeDecl RuntimeType = TypeDecl(t_rtfn);
+static TypeDecl BuiltinType = TypeDecl(t_builtin);
 static TypeDecl FuncType = TypeDecl(t_fn);
 static TypeDecl ClassType = TypeDecl(t_class);
 static TypeDecl StrType = TypeDecl(t_str);
@@ -235,11 +262,15 @@ class ValueType {
         EnumDecl* ed;
         std::string* str;
         TypeDecl* gen;
+        Channel* chan;
+        Task* task;
+        Generator* generator;
     } data;
 
     TypeDecl type;
     std::vector<MemStore*> ms;  // records
     bool isConst;
+    bool inFrame = false;  // storage owned by FrameStack
 
     ValueType() : type(VoidType) {
         data.ival = 0;
@@ -263,11 +294,22 @@ class ValueType {
                     delete data.fs;
                     return;
                 case t_class:
-                    delete data.st;
+                    if (!inFrame)
+                        delete data.st;
                     return;
                 case t_type:
                     delete data.gen;
                     return;
+                case t_chan:
+                    data.chan->release();
+                    return;
+                case t_future:
+                    if (data.task != nullptr)
+                        data.task->release();
+                    return;
+                case t_generator:
+                    delete data.generator;
+                    return;
                 default:
                     return;
             }
@@ -279,7 +321,7 @@ class ValueType {
     }
 
     explicit ValueType(TypeDecl *t, bool c = false) : type(*t), isConst(c) {
-        if (t->baseType == t_rtfn) {
+        if ((t->baseType == t_rtfn) || (t->baseType == t_builtin)) {
             data.ival = 0;
             return;
         }
@@ -331,7 +373,33 @@ class ValueType {
     }
 };
 
-static ValueType None = ValueType();
+inline ValueType None = ValueType();  // one object, compared by address
+
+// Frame Storage - objects that escape analysis proved to stay inside the
+// function creating them live in slots recycled across calls
+class FrameStack {
+ private:
+    struct Slot {
+        alignas(ValueType) unsigned char value[sizeof(ValueType)];
+        alignas(SymTable) unsigned char table[sizeof(SymTable)];
+        bool used = false;
+
+        ValueType *vt(void) { return reinterpret_cast<ValueType *>(value); }
+        SymTable *st(void) { return reinterpret_cast<SymTable *>(table); }
+    };
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::vector<size_t> bases;
+    size_t top = 0;
+
+    ValueType *promote(Slot *s);
+    void destroy(Slot *s);
+
+ public:
+    void enter(void);
+    ValueType *leave(ValueType *ret);
+    ValueType *newObject(bool in_frame, TypeDecl *t);
+    size_t depth(void) const { return bases.size(); }
+};
 
 enum globalStmtTypes {
     gs_error, gs_var, gs_func, gs_class, gs_union
@@ -347,7 +415,7 @@ class GlobalStatement {
 
 enum exprTypes {
     e_empty, e_var, e_if, e_while, e_for, e_match, e_ret, e_eval,
-    e_cont, e_break
+    e_cont, e_break, e_yield
 };
 class Expr {
  public:
@@ -359,16 +427,20 @@ class Expr {
 
 class Program : public ErrInfo {
  public:
+    std::unique_ptr<Arena> arena;  // owns every node below
     std::vector<std::string> imports;
-    std::vector<std::unique_ptr<GlobalStatement>> stmts;
-    explicit Program(scanner *Scanner) : ErrInfo(Scanner) {}
+    std::vector<GlobalStatement *> stmts;
+    explicit Program(ErrInfo at) : ErrInfo(at), arena(std::make_unique<Arena>()) {}
 
-    void insert(std::unique_ptr<GlobalStatement> s) {
-        if (s)
-            this->stmts.push_back(std::move(s));
+    void insert(GlobalStatement *s) {
+        if (s != nullptr)
+            this->stmts.push_back(s);
     }
     void declare(SymTable *st);
-    ValueType *interpret(SymTable *st);
+    // declares the variables, and leaves the rest to the first lookup
+    void defer(SymTable *st);
+    // imports the modules and declares the program in a new layer
+    void load(SymTable *st);
 
     D_MOVE_COPY(Program)
 };
@@ -376,33 +448,49 @@ class Program : public ErrInfo {
 class EvalExpr : public ErrInfo, public Expr {
  public:
     bool isVal;
-    std::unique_ptr<ExprVal> val;
+    ExprVal *val = nullptr;
     token op;
-    std::unique_ptr<EvalExpr> l, r;
+    EvalExpr *l = nullptr, *r = nullptr;
+    bool logical = false;  // a bool built from comparisons only, see test()
 
-    EvalExpr(scanner *Scanner, std::unique_ptr<ExprVal> v) :
-        ErrInfo(Scanner), isVal(true), val(std::move(v)) {
+    EvalExpr(ErrInfo at, ExprVal *v) :
+        ErrInfo(at), isVal(true), val(v) {
         this->exprType = e_eval;
     }
 
     EvalExpr(
-        scanner *Scanner,
+        ErrInfo at,
         token o,
-        std::unique_ptr<EvalExpr> l,
-        std::unique_ptr<EvalExpr> r) :
-        ErrInfo(Scanner), isVal(false), op(o), l(std::move(l)), r(std::move(r)) {
+        EvalExpr *l,
+        EvalExpr *r) :
+        ErrInfo(at), isVal(false), op(o), l(l), r(r) {
         this->exprType = e_eval;
+        switch (o) {
+            case equ: case neq: case lt: case le: case gt: case ge:
+                this->logical = true;
+                break;
+            case land: case lor:
+                this->logical = l->logical && r->logical;
+                break;
+            default:
+                break;
+        }
     }
     virtual ValueType *interpret(SymTable *st);
+    // the expression as the condition of an if, for or while; comparisons
+    // are decided in place instead of going through a bool ValueType
+    bool test(SymTable *st, ErrInfo *at);
 };
 
 class FuncCall : public ErrInfo {
  public:
-    std::vector<std::unique_ptr<EvalExpr>> pars;
+    std::vector<EvalExpr *> pars;
     Name function;
     Name gen_val;  // generic value
+    bool in_frame = false;  // result does not escape the caller
+    MemStore *linked = nullptr;  // function in an imported module, see link_program()
 
-    explicit FuncCall(scanner *Scanner) : ErrInfo(Scanner) {}
+    explicit FuncCall(ErrInfo at) : ErrInfo(at) {}
     ValueType *interpret(SymTable *st);
 
     D_MOVE_COPY(FuncCall)
@@ -416,15 +504,15 @@ class ExprVal : public ErrInfo {
     TypeDecl type;
 
     Name refName;
-    std::unique_ptr<FuncCall> call;
-    std::unique_ptr<EvalExpr> array;
+    FuncCall *call = nullptr;
+    EvalExpr *array = nullptr;
+    MemStore *linked = nullptr;  // refName in an imported module, see link_program()
+    std::unique_ptr<ValueType> folded;  // numeric constant parsed once, see EvalExpr::test()
 
-    ExprVal(scanner *Scanner, std::string v, TypeDecl t) :
-        ErrInfo(Scanner), isConst(true), constVal(v), type(t) {}
+    ExprVal(ErrInfo at, std::string v, TypeDecl t);
 
-    ExprVal(scanner *Scanner, Name n, std::unique_ptr<FuncCall> c, std::unique_ptr<EvalExpr> a) :
-        ErrInfo(Scanner), isConst(false), type(TypeDecl(t_void)), refName(n), call(std::move(c)),
-        array(std::move(a)) {
+    ExprVal(ErrInfo at, Name n, FuncCall *c, EvalExpr *a) :
+        ErrInfo(at), isConst(false), type(TypeDecl(t_void)), refName(n), call(c), array(a) {
         if (c != nullptr)
             c->function = n;
     }
@@ -438,14 +526,14 @@ class Param : public ErrInfo  {
     std::string name;
     TypeDecl type;
 
-    Param(scanner *Scanner, std::string n, TypeDecl t) : ErrInfo(Scanner), name(n), type(t) {}
+    Param(ErrInfo at, std::string n, TypeDecl t) : ErrInfo(at), name(n), type(t) {}
 };
 
 class RetExpr : public ErrInfo, public Expr {
  public:
-    std::unique_ptr<EvalExpr> stmt;
+    EvalExpr *stmt;
 
-    RetExpr(scanner *Scanner, std::unique_ptr<EvalExpr> s) : ErrInfo(Scanner), stmt(std::move(s)) {
+    RetExpr(ErrInfo at, EvalExpr *s) : ErrInfo(at), stmt(s) {
         this->exprType = e_ret;
     }
     virtual ValueType *interpret(SymTable *st);
@@ -453,9 +541,23 @@ class RetExpr : public ErrInfo, public Expr {
     D_MOVE_COPY(RetExpr)
 };
 
+// hands a value to whoever runs the generator, which goes on from here
+// when asked for the next one
+class YieldExpr : public ErrInfo, public Expr {
+ public:
+    EvalExpr *stmt;
+
+    YieldExpr(ErrInfo at, EvalExpr *s) : ErrInfo(at), stmt(s) {
+        this->exprType = e_yield;
+    }
+    virtual ValueType *interpret(SymTable *st);
+
+    D_MOVE_COPY(YieldExpr)
+};
+
 class ContExpr : public ErrInfo, public Expr {
  public:
-    explicit ContExpr(scanner *Scanner) : ErrInfo(Scanner) {
+    explicit ContExpr(ErrInfo at) : ErrInfo(at) {
         this->exprType = e_cont;
     }
     virtual ValueType *interpret(SymTable *st);
@@ -463,7 +565,7 @@ class ContExpr : public ErrInfo, public Expr {
 
 class BreakExpr : public ErrInfo, public Expr {
  public:
-    explicit BreakExpr(scanner *Scanner) : ErrInfo(Scanner) {
+    explicit BreakExpr(ErrInfo at) : ErrInfo(at) {
         this->exprType = e_break;
     }
     virtual ValueType *interpret(SymTable *st);
@@ -473,10 +575,20 @@ class ClassDecl : public ErrInfo, public GlobalStatement {
  public:
     Name name;
     GenericDecl gen;
-    std::vector<std::unique_ptr<GlobalStatement>> stmts;
-
-    ClassDecl(scanner *Scanner, std::string n, GenericDecl g) :
-        ErrInfo(Scanner), name(Name(n)), gen(g) {
+    std::vector<GlobalStatement *> stmts;
+
+    // what every construction repeats, worked out by the first one
+    struct Plan {
+        FuncDecl *ctor = nullptr;
+        TypeDecl type = TypeDecl(t_class);  // of the instances
+        std::vector<Name> slots;  // constructor parameters
+        Name gen;
+        Name self = Name("this");
+    } plan;
+    std::once_flag planned;
+
+    ClassDecl(ErrInfo at, std::string n, GenericDecl g) :
+        ErrInfo(at), name(Name(n)), gen(g) {
         this->stmtType = gs_class;
     }
     virtual ValueType *interpret(SymTable *st) {
@@ -492,10 +604,10 @@ class EnumDecl : public ErrInfo {
  public:
     Name name;
     GenericDecl gen;
-    std::vector<std::unique_ptr<VarDecl>> vars;
+    std::vector<VarDecl *> vars;
 
-    EnumDecl(scanner *Scanner, Name n) :
-        ErrInfo(Scanner), name(n) {}
+    EnumDecl(ErrInfo at, Name n) :
+        ErrInfo(at), name(n) {}
 
     D_MOVE_COPY(EnumDecl)
 };
@@ -504,16 +616,16 @@ class VarDecl : public ErrInfo, public GlobalStatement, public Expr {
  public:
     Name name;
     TypeDecl type;
-    std::unique_ptr<EvalExpr> init;
+    EvalExpr *init;
     bool is_global = false;
     bool is_const = false;
 
     VarDecl(
-        scanner *Scanner,
+        ErrInfo at,
         std::string n,
         TypeDecl t,
-        std::unique_ptr<EvalExpr> i) :
-        ErrInfo(Scanner), name(Name(n)), type(t), init(std::move(i)) {
+        EvalExpr *i) :
+        ErrInfo(at), name(Name(n)), type(t), init(i) {
         this->stmtType = gs_var;
         this->exprType = e_var;
     }
@@ -531,11 +643,41 @@ class FuncDecl : public ErrInfo, public GlobalStatement {
     GenericDecl genType;
     std::vector<Param> pars;
     TypeDecl ret;
-    std::vector<std::unique_ptr<Expr>> exprs;
-
-    FuncDecl(scanner *Scanner, Name n, GenericDecl g, std::vector<Param> prms, TypeDecl r) :
-        ErrInfo(Scanner), name(n), genType(g), pars(prms), ret(r) {
+    std::vector<Expr *> exprs;
+
+    // a lazily parsed body is only brace-matched up front: where its '{'
+    // is, and the arena its nodes go to once the first call parses it
+    SourceLoc body = 0;
+    int body_row = 0;
+    Arena *arena = nullptr;
+    std::once_flag parsed;
+
+    // signature: the name each argument is bound to, and which part of
+    // its type a generic value replaces
+    enum { gen_none, gen_other, gen_param };
+    std::vector<Name> slots;
+    std::vector<uint8_t> generic;
+
+    // a call of a generator (its body yields) or of an async function
+    // returns at once, and the body runs as a coroutine; generator is
+    // known once the body is parsed
+    bool generator = false;
+    bool is_async = false;
+
+    FuncDecl(ErrInfo at, Name n, GenericDecl g, std::vector<Param> prms, TypeDecl r) :
+        ErrInfo(at), name(n), genType(g), pars(prms), ret(r) {
         this->stmtType = gs_func;
+        for (auto&& prm : pars) {
+            slots.push_back(Name(prm.name));
+            if (prm.type.baseType != t_class)
+                generic.push_back(gen_none);
+            else if (prm.type.other == genType.name)
+                generic.push_back(gen_other);
+            else if (prm.type.gen.name == genType.name)
+                generic.push_back(gen_param);
+            else
+                generic.push_back(gen_none);
+        }
     }
     virtual ValueType *interpret(SymTable *st);
     virtual void declare(SymTable *st, SymTable *context);
@@ -546,11 +688,11 @@ class FuncDecl : public ErrInfo, public GlobalStatement {
 class UnionDecl : public ErrInfo, public GlobalStatement {
  public:
     Name name;
-    std::vector<std::unique_ptr<EnumDecl>> classes;
+    std::vector<EnumDecl *> classes;
     GenericDecl gen;
 
-    UnionDecl(scanner *Scanner, Name n, GenericDecl gen) :
-        ErrInfo(Scanner), name(n), gen(gen) {
+    UnionDecl(ErrInfo at, Name n, GenericDecl gen) :
+        ErrInfo(at), name(n), gen(gen) {
         this->stmtType = gs_union;
     }
     virtual ValueType *interpret(SymTable *st) {
@@ -563,12 +705,12 @@ class UnionDecl : public ErrInfo, public GlobalStatement {
 
 class IfExpr : public ErrInfo, public Expr {
  public:
-    std::unique_ptr<EvalExpr> cond;
-    std::vector<std::unique_ptr<Expr>> iftrue;
-    std::vector<std::unique_ptr<Expr>> iffalse;
+    EvalExpr *cond;
+    std::vector<Expr *> iftrue;
+    std::vector<Expr *> iffalse;
 
-    IfExpr(scanner *Scanner, std::unique_ptr<EvalExpr> c) :
-        ErrInfo(Scanner), cond(std::move(c)) {
+    IfExpr(ErrInfo at, EvalExpr *c) :
+        ErrInfo(at), cond(c) {
         this->exprType = e_if;
     }
     virtual ValueType *interpret(SymTable *st);
@@ -578,11 +720,11 @@ class IfExpr : public ErrInfo, public Expr {
 
 class WhileExpr : public ErrInfo, public Expr {
  public:
-    std::unique_ptr<EvalExpr> cond;
-    std::vector<std::unique_ptr<Expr>> exprs;
+    EvalExpr *cond;
+    std::vector<Expr *> exprs;
 
-    WhileExpr(scanner *Scanner, std::unique_ptr<EvalExpr> c) :
-        ErrInfo(Scanner), cond(std::move(c)) {
+    WhileExpr(ErrInfo at, EvalExpr *c) :
+        ErrInfo(at), cond(c) {
         this->exprType = e_while;
     }
     virtual ValueType *interpret(SymTable *st);
@@ -592,15 +734,22 @@ class WhileExpr : public ErrInfo, public Expr {
 
 class ForExpr : public ErrInfo, public Expr {
  public:
-    std::unique_ptr<EvalExpr> init, cond, step;
-    std::vector<std::unique_ptr<Expr>> exprs;
+    EvalExpr *init, *cond, *step;
+    std::vector<Expr *> exprs;
+
+    // `parallel for`: the iterations run on a thread pool, once
+    // parallel_check() has shown them independent of each other
+    bool parallel = false;
+    std::once_flag checked;
+    Name index;
+    std::vector<Name> arrays;  // written at the index
 
     ForExpr(
-        scanner *Scanner,
-        std::unique_ptr<EvalExpr> i,
-        std::unique_ptr<EvalExpr> c,
-        std::unique_ptr<EvalExpr> s) :
-        ErrInfo(Scanner), init(std::move(i)), cond(std::move(c)), step(std::move(s)) {
+        ErrInfo at,
+        EvalExpr *i,
+        EvalExpr *c,
+        EvalExpr *s) :
+        ErrInfo(at), init(i), cond(c), step(s) {
         this->exprType = e_for;
     }
     virtual ValueType *interpret(SymTable *st);
@@ -612,21 +761,21 @@ class MatchLine : public ErrInfo  {
  public:
     std::string name;
     std::string cl_name;
-    std::vector<std::unique_ptr<Expr>> exprs;
+    std::vector<Expr *> exprs;
 
-    MatchLine(scanner *Scanner, std::string n, std::string cl) :
-        ErrInfo(Scanner), name(n), cl_name(cl) {}
+    MatchLine(ErrInfo at, std::string n, std::string cl) :
+        ErrInfo(at), name(n), cl_name(cl) {}
 
     D_MOVE_COPY(MatchLine)
 };
 
 class MatchExpr : public ErrInfo, public Expr {
  public:
-    std::unique_ptr<EvalExpr> var;
+    EvalExpr *var;
     std::vector<MatchLine> lines;
 
-    MatchExpr(scanner *Scanner, std::unique_ptr<EvalExpr> v) :
-        ErrInfo(Scanner), var(std::move(v)) {
+    MatchExpr(ErrInfo at, EvalExpr *v) :
+        ErrInfo(at), var(v) {
         this->exprType = e_match;
     }
     virtual ValueType *interpret(SymTable *st);
@@ -634,5 +783,103 @@ class MatchExpr : public ErrInfo, public Expr {
     D_MOVE_COPY(MatchExpr)
 };
 
-extern int interpret(Program prog);
+// Everything one running program changes besides its own tree. Separate
+// interpreters may run on separate threads; code on a thread works for the
+// interpreter that thread is running.
+class Interpreter {
+ private:
+    static thread_local Interpreter *active;
+
+    std::unique_ptr<Program> program;
+    SymTable *root = nullptr;
+
+    // calls of spawn() not finished yet, and what they may see of the
+    // program: its functions, classes and modules, taken when it was loaded
+    Interpreter *owner = this;
+    std::unique_ptr<SymTable> shared;
+    std::mutex spawn_lock;
+    std::condition_variable spawn_done;
+    size_t spawned = 0;
+    std::exception_ptr spawn_error;
+
+    // waits for the spawned calls, with `stop` those waiting on a channel
+    // give up
+    void join(bool stop);
+
+ public:
+    // makes an interpreter the one of the calling thread until destroyed
+    class Scope {
+        Interpreter *outer;
+     public:
+        explicit Scope(Interpreter *in) : outer(active) { active = in; }
+        ~Scope() { active = outer; }
+    };
+
+    // return / continue / break still unwinding the statements
+    int return_flag = 0;
+    int continue_flag = 0;
+    int break_flag = 0;
+    FrameStack frames;
+    // imported modules by name, their symbol tables and source files
+    std::map<std::string, std::unique_ptr<Program>> imports;
+    std::map<std::string, SymTable *> module_tables;
+    std::map<std::string, std::pair<std::string, int64_t>> module_files;  // path, mtime
+    // imported modules stay declared for the next program loaded, as long
+    // as none of their files changed
+    bool resident = false;
+    // or, unload() keeps only their trees to declare afresh, by path
+    bool reuse_modules = false;
+    std::map<std::string, std::pair<int64_t, std::unique_ptr<Program>>> spare;
+    std::ostream *out = &std::cout;  // print() and debug()
+    std::mutex out_lock;  // whole lines from every thread of the program
+    std::atomic<bool> stopping{false};  // the program is being unloaded
+    // the coroutine running the call of a generator or async function this
+    // interpreter runs: yield, and the waits of an async call, suspend it
+    Coroutine *coroutine = nullptr;
+
+    Interpreter() {}
+    Interpreter(const Interpreter &) = delete;
+    Interpreter& operator= (const Interpreter &) = delete;
+    ~Interpreter();
+
+    // Declares the program once; call() may then run its functions any
+    // number of times, global variables keep their values in between.
+    // Replaces the program loaded before.
+    void load(Program prog);
+    // Calls a function of the loaded program, `mod.name` for one of its
+    // imports. The arguments are taken over, the caller owns the result
+    // unless it is a stored value (ms not empty) or & None.
+    ValueType *call(const std::string &name, std::vector<ValueType *> args);
+    void unload(void);
+
+    // runs main() of the program on the calling thread, and waits for
+    // the calls it spawned
+    int run(Program prog);
+
+    // Queues a call of the function for the scheduler, which takes over
+    // the arguments; the caller holds the returned task. The program is
+    // unloaded only once every such call has finished; if one fails, run()
+    // reports its error.
+    Task *spawn(FuncDecl *fd, std::vector<ValueType *> args);
+    // runs a spawned call on the calling thread, for the program this
+    // interpreter loaded; the caller owns the result
+    ValueType *execute(FuncDecl *fd, std::vector<ValueType *> args);
+    // a call that may outlive its caller: what a spawned call sees of the
+    // program, with the arguments in a layer of their own
+    std::unique_ptr<SymTable> bind(FuncDecl *fd, std::vector<ValueType *> args);
+    // runs a call bound by bind() on the calling thread as execute() does,
+    // from the coroutine `co` if given
+    ValueType *invoke(FuncDecl *fd, SymTable *st, Coroutine *co = nullptr);
+    // counts a call as spawned until it calls finish()
+    void hold(void);
+    // a spawned call is over, `error` is what it threw
+    void finish(std::exception_ptr error);
+    // the interpreter that loaded the program, this one unless it runs a
+    // spawned call
+    Interpreter *top(void) { return this->owner; }
+    // the error of the first spawned call that failed, if any did
+    std::exception_ptr spawned_error(void);
+
+    static Interpreter *current(void) { return active; }
+};
 }  // namespace AST
@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#include "batch.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "ast.hpp"
+#include "pool.hpp"
+#include "serve.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Job {
+    std::string path;
+    std::string output;
+    int status = 0;
+    double ms = 0;
+};
+
+void manifest(const std::string &file, std::vector<Job> *jobs) {
+    std::ifstream in(file);
+    if (!in)
+        throw std::runtime_error("open() error: " + file);
+    auto dir = fs::path(file).parent_path();
+    std::string line;
+    while (std::getline(in, line)) {
+        auto begin = line.find_first_not_of(" \t\r");
+        if ((begin == std::string::npos) || (line[begin] == '#'))
+            continue;
+        auto end = line.find_last_not_of(" \t\r");
+        Job job;
+        job.path = (dir / line.substr(begin, end - begin + 1)).string();
+        jobs->push_back(job);
+    }
+}
+
+void run(Job *job, const fs::path &cwd) {
+    // module trees stay parsed for the next program on this thread
+    static thread_local AST::Interpreter in;
+    in.reuse_modules = true;
+
+    std::ostringstream out;
+    auto start = std::chrono::steady_clock::now();
+    job->status = run_script(&in, job->path, "", cwd, out);
+    job->ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    job->output = out.str();
+}
+
+}  // namespace
+
+int batch(const std::vector<std::string> &args) {
+    std::vector<Job> jobs;
+    unsigned int threads = 0;
+    for (auto&& arg : args) {
+        if ((arg.size() > 2) && (arg.compare(0, 2, "-j") == 0)) {
+            threads = std::stoul(arg.substr(2));
+        } else if ((arg.size() > 1) && (arg[0] == '@')) {
+            manifest(arg.substr(1), &jobs);
+        } else {
+            Job job;
+            job.path = arg;
+            jobs.push_back(job);
+        }
+    }
+
+    auto cwd = fs::current_path();
+    auto start = std::chrono::steady_clock::now();
+    {
+        // leaving the scope waits for every job
+        ThreadPool pool(threads);
+        for (auto&& job : jobs) {
+            auto p = &job;
+            pool.submit([p, cwd] { run(p, cwd); });
+        }
+    }
+    auto ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+
+    int failed = 0;
+    char timing[64];
+    for (auto&& job : jobs) {
+        failed += job.status;
+        std::snprintf(timing, sizeof(timing), "%.2f ms", job.ms);
+        std::cout << "=== " << job.path << ": " << ((job.status == 0) ? "ok" : "failed")
+            << " (" << timing << ")" << std::endl << job.output;
+    }
+    std::snprintf(timing, sizeof(timing), "%.2f ms", ms);
+    std::cout << "--- " << jobs.size() << " programs, " << failed << " failed, "
+        << timing << std::endl;
+    return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * running many programs in one process
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Runs the programs on a thread pool and prints the output of each one
+// after a line with its status and run time, in the order given. An
+// argument @file names a manifest, one path per line relative to the
+// manifest; empty lines and lines starting with # are skipped. -jN sets
+// the number of threads, one per hardware thread by default. Each worker
+// thread parses a module once and declares it afresh for every program
+// importing it. Returns 1 if any program failed.
+extern int batch(const std::vector<std::string> &args);
@@ -0,0 +1,764 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * A .ycc file is a header followed by the program tree in pre-order. The
+ * header holds the source hash and length, and a checksum of the tree.
+ * Integers are little endian u8/u32/u64, strings are a u32 length and the
+ * bytes, optional children a u8 presence flag. Source locations are stored
+ * relative to the file so they can be rebased on load. A function body not
+ * parsed yet is stored as the location and row of its '{'.
+ */
+
+#include "cache.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "analysis.hpp"
+#include "link.hpp"
+#include "parser.hpp"
+#include "scanner.hpp"
+#include "source.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char magic[4] = {'Y', 'C', 'C', '\0'};
+
+// FNV-1a over 8 byte words: detects changes, and runs at memory speed
+// over the source and the cache alike
+uint64_t content_hash(const char *p, size_t n) {
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t h = 0xcbf29ce484222325ull ^ n;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * prime;
+        h ^= h >> 29;
+    }
+    for (; i < n; ++i)
+        h = (h ^ (uint8_t)p[i]) * prime;
+    return h;
+}
+
+std::string cache_path(const std::string &path) {
+    auto dir = std::getenv("YC_CACHE_DIR");
+    if ((dir != nullptr) && (*dir != '\0')) {
+        // one flat directory: keep modules of the same name apart
+        auto full = fs::absolute(path).string();
+        std::stringstream ss;
+        ss << std::hex << content_hash(full.data(), full.size()) << '-'
+           << fs::path(path).filename().string() << 'c';
+        return (fs::path(dir) / ss.str()).string();
+    }
+    return path + 'c';
+}
+
+/**
+ * Writer
+ */
+class Writer {
+ private:
+    SourceLoc base;
+
+ public:
+    std::string out;
+
+    explicit Writer(SourceLoc base) : base(base) {}
+
+    void u8(uint8_t v) { out += (char)v; }
+    void u32(uint32_t v) {
+        for (int i = 0; i < 4; ++i) u8((v >> (8 * i)) & 0xFF);
+    }
+    void u64(uint64_t v) {
+        for (int i = 0; i < 8; ++i) u8((v >> (8 * i)) & 0xFF);
+    }
+    void str(const std::string &s) {
+        u32(s.size());
+        out += s;
+    }
+    void loc(SourceLoc l) {
+        u32((l == 0) ? 0 : (l - base + 1));
+    }
+    void loc(const ErrInfo *e) {
+        loc(e->loc);
+    }
+
+    void name(const AST::Name &n) {
+        u32(n.ClassName.size());
+        for (auto&& c : n.ClassName)
+            str(c);
+        str(n.BaseName);
+    }
+    // the parser leaves invalid generics blank
+    void generic(const AST::GenericDecl &g) {
+        u8(g.valid);
+        if (g.valid) {
+            loc(&g);
+            name(g.name);
+        }
+    }
+    void type(const AST::TypeDecl &t) {
+        loc(&t);
+        u8(t.baseType);
+        u32(t.arrayT);
+        bool has_other = (t.other.BaseName.size() != 0) || (t.other.ClassName.size() != 0);
+        u8(has_other | ((t.enum_base.size() != 0) << 1));
+        if (has_other)
+            name(t.other);
+        if (t.enum_base.size() != 0)
+            str(t.enum_base);
+        generic(t.gen);
+    }
+
+    void eval(const AST::EvalExpr *e);
+
+    void opt_eval(const AST::EvalExpr *e) {
+        u8(e != nullptr);
+        if (e != nullptr)
+            eval(e);
+    }
+
+    void call(const AST::FuncCall *c) {
+        loc(c);
+        u32(c->pars.size());
+        for (auto&& p : c->pars)
+            eval(p);
+        name(c->function);
+        name(c->gen_val);
+        u8(c->in_frame);
+    }
+
+    // constants only carry a base type, references are always void typed
+    void val(const AST::ExprVal *v) {
+        loc(v);
+        u8(v->isConst);
+        if (v->isConst) {
+            str(v->constVal);
+            u8(v->type.baseType);
+        } else {
+            name(v->refName);
+            u8(v->call != nullptr);
+            if (v->call != nullptr)
+                call(v->call);
+            opt_eval(v->array);
+        }
+    }
+
+    void var(const AST::VarDecl *vd) {
+        loc(vd);
+        name(vd->name);
+        type(vd->type);
+        opt_eval(vd->init);
+        u8(vd->is_global);
+        u8(vd->is_const);
+    }
+
+    void exprs(const std::vector<AST::Expr *> &es);
+    void stmt(const AST::GlobalStatement *gs);
+    void program(const AST::Program *prog);
+};
+
+void Writer::eval(const AST::EvalExpr *e) {
+    loc(e);
+    u8(e->isVal);
+    if (e->isVal) {
+        val(e->val);
+    } else {
+        u32(e->op);
+        opt_eval(e->l);
+        opt_eval(e->r);
+    }
+}
+
+void Writer::exprs(const std::vector<AST::Expr *> &es) {
+    u32(es.size());
+    for (auto&& e : es) {
+        u8(e->exprType);
+        switch (e->exprType) {
+            case AST::e_empty:
+                break;
+            case AST::e_var:
+                var(static_cast<AST::VarDecl *>(e));
+                break;
+            case AST::e_if: {
+                auto ie = static_cast<AST::IfExpr *>(e);
+                loc(ie);
+                opt_eval(ie->cond);
+                exprs(ie->iftrue);
+                exprs(ie->iffalse);
+                break;
+            }
+            case AST::e_while: {
+                auto we = static_cast<AST::WhileExpr *>(e);
+                loc(we);
+                opt_eval(we->cond);
+                exprs(we->exprs);
+                break;
+            }
+            case AST::e_for: {
+                auto fe = static_cast<AST::ForExpr *>(e);
+                loc(fe);
+                u8(fe->parallel);
+                opt_eval(fe->init);
+                opt_eval(fe->cond);
+                opt_eval(fe->step);
+                exprs(fe->exprs);
+                break;
+            }
+            case AST::e_match: {
+                auto me = static_cast<AST::MatchExpr *>(e);
+                loc(me);
+                opt_eval(me->var);
+                u32(me->lines.size());
+                for (auto&& line : me->lines) {
+                    loc(&line);
+                    str(line.name);
+                    str(line.cl_name);
+                    exprs(line.exprs);
+                }
+                break;
+            }
+            case AST::e_ret: {
+                auto re = static_cast<AST::RetExpr *>(e);
+                loc(re);
+                opt_eval(re->stmt);
+                break;
+            }
+            case AST::e_yield: {
+                auto ye = static_cast<AST::YieldExpr *>(e);
+                loc(ye);
+                opt_eval(ye->stmt);
+                break;
+            }
+            case AST::e_eval:
+                eval(static_cast<AST::EvalExpr *>(e));
+                break;
+            case AST::e_cont:
+                loc(static_cast<AST::ContExpr *>(e));
+                break;
+            case AST::e_break:
+                loc(static_cast<AST::BreakExpr *>(e));
+                break;
+        }
+    }
+}
+
+void Writer::stmt(const AST::GlobalStatement *gs) {
+    u8(gs->stmtType);
+    switch (gs->stmtType) {
+        case AST::gs_var:
+            var(static_cast<const AST::VarDecl *>(gs));
+            break;
+        case AST::gs_func: {
+            auto fd = static_cast<const AST::FuncDecl *>(gs);
+            loc(fd);
+            name(fd->name);
+            generic(fd->genType);
+            u32(fd->pars.size());
+            for (auto&& p : fd->pars) {
+                loc(&p);
+                str(p.name);
+                type(p.type);
+            }
+            type(fd->ret);
+            u8(fd->is_async);
+            loc(fd->body);
+            if (fd->body != 0) {
+                u32(fd->body_row);
+            } else {
+                u8(fd->generator);
+                exprs(fd->exprs);
+            }
+            break;
+        }
+        case AST::gs_class: {
+            auto cl = static_cast<const AST::ClassDecl *>(gs);
+            loc(cl);
+            name(cl->name);
+            generic(cl->gen);
+            u32(cl->stmts.size());
+            for (auto&& s : cl->stmts)
+                stmt(s);
+            break;
+        }
+        case AST::gs_union: {
+            auto un = static_cast<const AST::UnionDecl *>(gs);
+            loc(un);
+            name(un->name);
+            generic(un->gen);
+            u32(un->classes.size());
+            for (auto&& en : un->classes) {
+                loc(en);
+                name(en->name);
+                generic(en->gen);
+                u32(en->vars.size());
+                for (auto&& vd : en->vars)
+                    var(vd);
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error("cache: cannot store statement");
+    }
+}
+
+void Writer::program(const AST::Program *prog) {
+    loc(prog);
+    u32(prog->imports.size());
+    for (auto&& i : prog->imports)
+        str(i);
+    u32(prog->stmts.size());
+    for (auto&& s : prog->stmts)
+        stmt(s);
+}
+
+/**
+ * Reader - every read is bounds checked, a damaged file is simply ignored
+ */
+struct CacheError {};
+
+class Reader {
+ private:
+    const char *p;
+    const char *end;
+    SourceLoc base;
+    size_t length;  // of the source
+    AST::Arena *arena = nullptr;
+
+    void need(size_t n) {
+        if ((size_t)(end - p) < n)
+            throw CacheError();
+    }
+
+ public:
+    bool lazy = false;  // some body is left unparsed
+
+    Reader(const char *p, size_t n, SourceLoc base, size_t length) :
+        p(p), end(p + n), base(base), length(length) {}
+
+    uint8_t u8(void) {
+        need(1);
+        return (uint8_t)*p++;
+    }
+    uint32_t u32(void) {
+        need(4);
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) v |= (uint32_t)(uint8_t)p[i] << (8 * i);
+        p += 4;
+        return v;
+    }
+    uint64_t u64(void) {
+        need(8);
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) v |= (uint64_t)(uint8_t)p[i] << (8 * i);
+        p += 8;
+        return v;
+    }
+    // element counts can never exceed the bytes left
+    uint32_t count(void) {
+        auto n = u32();
+        need(n);
+        return n;
+    }
+    std::string str(void) {
+        auto n = count();
+        std::string s(p, n);
+        p += n;
+        return s;
+    }
+    ErrInfo loc(void) {
+        auto v = u32();
+        if (v == 0)
+            return ErrInfo();
+        if (v - 1 > length)
+            throw CacheError();
+        return ErrInfo(base + v - 1);
+    }
+    bool done(void) const { return p == end; }
+    const char *pos(void) const { return p; }
+    size_t left(void) const { return end - p; }
+
+    AST::Name name(void) {
+        AST::Name n;
+        auto size = count();
+        for (uint32_t i = 0; i < size; ++i)
+            n.ClassName.push_back(str());
+        n.BaseName = str();
+        return n;
+    }
+    AST::GenericDecl generic(void) {
+        if (!u8())
+            return AST::GenericDecl();
+        auto at = loc();
+        return AST::GenericDecl(at, name());
+    }
+    AST::Types base_type(void) {
+        auto t = u8();
+        if (t > AST::t_generator)
+            throw CacheError();
+        return (AST::Types)t;
+    }
+    AST::TypeDecl type(void) {
+        auto at = loc();
+        auto t = base_type();
+        int arr = u32();
+        auto parts = u8();
+        AST::Name other;
+        if (parts & 1)
+            other = name();
+        std::string enum_base;
+        if (parts & 2)
+            enum_base = str();
+        auto gen = generic();
+        if ((t != AST::t_class) && (t != AST::t_chan) && (t != AST::t_future) &&
+            (t != AST::t_generator) && gen.valid)
+            throw CacheError();
+        AST::TypeDecl td(at, t, other, gen, arr);
+        td.enum_base = enum_base;
+        return td;
+    }
+
+    AST::EvalExpr *eval(void);
+
+    AST::EvalExpr *opt_eval(void) {
+        return u8() ? eval() : nullptr;
+    }
+
+    AST::FuncCall *call(void) {
+        auto c = arena->make<AST::FuncCall>(loc());
+        auto n = count();
+        for (uint32_t i = 0; i < n; ++i)
+            c->pars.push_back(eval());
+        c->function = name();
+        c->gen_val = name();
+        c->in_frame = u8();
+        return c;
+    }
+
+    AST::ExprVal *val(void) {
+        auto at = loc();
+        if (u8()) {
+            auto const_val = str();
+            return arena->make<AST::ExprVal>(at, const_val, AST::TypeDecl(base_type()));
+        }
+        auto ref = name();
+        auto c = u8() ? call() : nullptr;
+        auto arr = opt_eval();
+        return arena->make<AST::ExprVal>(at, ref, c, arr);
+    }
+
+    AST::VarDecl *var(void) {
+        auto at = loc();
+        auto n = name();
+        auto t = type();
+        auto init = opt_eval();
+        auto vd = arena->make<AST::VarDecl>(at, n.BaseName, t, init);
+        vd->name = n;
+        vd->is_global = u8();
+        vd->is_const = u8();
+        return vd;
+    }
+
+    std::vector<AST::Expr *> exprs(void);
+    AST::GlobalStatement *stmt(void);
+    std::unique_ptr<AST::Program> program(void);
+};
+
+AST::EvalExpr *Reader::eval(void) {
+    auto at = loc();
+    if (u8())
+        return arena->make<AST::EvalExpr>(at, val());
+    auto op = u32();
+    if (op > t_eof)
+        throw CacheError();
+    auto l = opt_eval();
+    auto r = opt_eval();
+    return arena->make<AST::EvalExpr>(at, (token)op, l, r);
+}
+
+std::vector<AST::Expr *> Reader::exprs(void) {
+    std::vector<AST::Expr *> es;
+    auto n = count();
+    for (uint32_t i = 0; i < n; ++i) {
+        switch (u8()) {
+            case AST::e_empty:
+                es.push_back(arena->make<AST::Expr>());
+                break;
+            case AST::e_var:
+                es.push_back(var());
+                break;
+            case AST::e_if: {
+                auto at = loc();
+                auto ie = arena->make<AST::IfExpr>(at, opt_eval());
+                ie->iftrue = exprs();
+                ie->iffalse = exprs();
+                es.push_back(ie);
+                break;
+            }
+            case AST::e_while: {
+                auto at = loc();
+                auto we = arena->make<AST::WhileExpr>(at, opt_eval());
+                we->exprs = exprs();
+                es.push_back(we);
+                break;
+            }
+            case AST::e_for: {
+                auto at = loc();
+                bool parallel = u8();
+                auto init = opt_eval();
+                auto cond = opt_eval();
+                auto step = opt_eval();
+                auto fe = arena->make<AST::ForExpr>(at, init, cond, step);
+                fe->parallel = parallel;
+                fe->exprs = exprs();
+                es.push_back(fe);
+                break;
+            }
+            case AST::e_match: {
+                auto at = loc();
+                auto me = arena->make<AST::MatchExpr>(at, opt_eval());
+                auto lines = count();
+                for (uint32_t j = 0; j < lines; ++j) {
+                    auto line_at = loc();
+                    auto line_name = str();
+                    auto cl_name = str();
+                    auto line = AST::MatchLine(line_at, line_name, cl_name);
+                    line.exprs = exprs();
+                    me->lines.push_back(std::move(line));
+                }
+                es.push_back(me);
+                break;
+            }
+            case AST::e_ret: {
+                auto at = loc();
+                es.push_back(arena->make<AST::RetExpr>(at, opt_eval()));
+                break;
+            }
+            case AST::e_yield: {
+                auto at = loc();
+                es.push_back(arena->make<AST::YieldExpr>(at, opt_eval()));
+                break;
+            }
+            case AST::e_eval:
+                es.push_back(eval());
+                break;
+            case AST::e_cont:
+                es.push_back(arena->make<AST::ContExpr>(loc()));
+                break;
+            case AST::e_break:
+                es.push_back(arena->make<AST::BreakExpr>(loc()));
+                break;
+            default:
+                throw CacheError();
+        }
+    }
+    return es;
+}
+
+AST::GlobalStatement *Reader::stmt(void) {
+    switch (u8()) {
+        case AST::gs_var:
+            return var();
+        case AST::gs_func: {
+            auto at = loc();
+            auto n = name();
+            auto gen = generic();
+            std::vector<AST::Param> prms;
+            auto size = count();
+            for (uint32_t i = 0; i < size; ++i) {
+                auto par_at = loc();
+                auto par_name = str();
+                prms.push_back(AST::Param(par_at, par_name, type()));
+            }
+            auto ret = type();
+            auto fd = arena->make<AST::FuncDecl>(at, n, gen, prms, ret);
+            fd->is_async = u8();
+            fd->body = loc().loc;
+            if (fd->body != 0) {
+                fd->body_row = u32();
+                fd->arena = arena;
+                lazy = true;
+            } else {
+                fd->generator = u8();
+                fd->exprs = exprs();
+            }
+            return fd;
+        }
+        case AST::gs_class: {
+            auto at = loc();
+            auto n = name();
+            auto cl = arena->make<AST::ClassDecl>(at, n.BaseName, generic());
+            cl->name = n;
+            auto size = count();
+            for (uint32_t i = 0; i < size; ++i)
+                cl->stmts.push_back(stmt());
+            return cl;
+        }
+        case AST::gs_union: {
+            auto at = loc();
+            auto n = name();
+            auto un = arena->make<AST::UnionDecl>(at, n, generic());
+            auto size = count();
+            for (uint32_t i = 0; i < size; ++i) {
+                auto en_at = loc();
+                auto en = arena->make<AST::EnumDecl>(en_at, name());
+                en->gen = generic();
+                auto vars = count();
+                for (uint32_t j = 0; j < vars; ++j)
+                    en->vars.push_back(var());
+                un->classes.push_back(en);
+            }
+            return un;
+        }
+        default:
+            throw CacheError();
+    }
+}
+
+std::unique_ptr<AST::Program> Reader::program(void) {
+    auto prog = std::make_unique<AST::Program>(loc());
+    arena = prog->arena.get();
+    auto n = count();
+    for (uint32_t i = 0; i < n; ++i)
+        prog->imports.push_back(str());
+    n = count();
+    for (uint32_t i = 0; i < n; ++i)
+        prog->insert(stmt());
+    return prog;
+}
+
+// an eager load cannot use a cache that left bodies unparsed
+std::unique_ptr<AST::Program> cache_read(const std::string &cpath, SourceFile *file, uint64_t hash, bool lazy) {
+    int fd = open(cpath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat sb;
+    void *map = MAP_FAILED;
+    if ((fstat(fd, &sb) == 0) && (sb.st_size > 0))
+        map = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return nullptr;
+
+    std::unique_ptr<AST::Program> prog;
+    try {
+        Reader r(static_cast<const char *>(map), sb.st_size, file->base, file->length);
+        char m[4];
+        for (auto&& c : m) c = r.u8();
+        if ((memcmp(m, magic, 4) != 0) || (r.u32() != YCC_FORMAT) || (r.str() != YC_VERSION))
+            throw CacheError();
+        if ((r.u64() != hash) || (r.u64() != file->length))
+            throw CacheError();
+        if (r.u64() != content_hash(r.pos(), r.left()))
+            throw CacheError();
+        prog = r.program();
+        if ((!r.done()) || (r.lazy && !lazy))
+            throw CacheError();
+    } catch (CacheError &) {
+        prog = nullptr;
+    } catch (std::exception &) {
+        prog = nullptr;
+    }
+    munmap(map, sb.st_size);
+    return prog;
+}
+
+void cache_write(const std::string &cpath, const AST::Program *prog, SourceFile *file, uint64_t hash) {
+    Writer body(file->base);
+    body.program(prog);
+
+    Writer w(file->base);
+    for (auto c : magic) w.u8(c);
+    w.u32(YCC_FORMAT);
+    w.str(YC_VERSION);
+    w.u64(hash);
+    w.u64(file->length);
+    w.u64(content_hash(body.out.data(), body.out.size()));
+    w.out += body.out;
+
+    // write aside and rename, concurrent runs never see half a file
+    std::error_code ec;
+    fs::create_directories(fs::path(cpath).parent_path(), ec);
+    auto tmp = cpath + ".tmp" + std::to_string(getpid()) + "."
+        + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return;  // read only location, run without a cache
+        out.write(w.out.data(), w.out.size());
+        if (!out) {
+            out.close();
+            fs::remove(tmp, ec);
+            return;
+        }
+    }
+    fs::rename(tmp, cpath, ec);
+    if (ec)
+        fs::remove(tmp, ec);
+}
+
+}  // namespace
+
+std::unique_ptr<AST::Program> load_program(std::string path, std::string filename, bool lazy) {
+    auto file = sources.load(path, filename);
+    bool use_cache = (std::getenv("YC_NO_CACHE") == nullptr);
+    lazy = lazy && (std::getenv("YC_EAGER") == nullptr);
+
+    uint64_t hash = 0;
+    std::string cpath;
+    if (use_cache) {
+        hash = content_hash(file->buf, file->length);
+        cpath = cache_path(path);
+        auto prog = cache_read(cpath, file, hash, lazy);
+        if (prog != nullptr) {
+            if (!lazy)
+                file->release();
+            return prog;
+        }
+    }
+
+    // lazy bodies are parsed from the source later, keep it resident
+    auto sc = scanner(file);
+    auto prog = parse(&sc, lazy);
+    if (!lazy)
+        sc.Free();
+    analyze(prog.get());
+
+    if (use_cache)
+        cache_write(cpath, prog.get(), file, hash);
+    return prog;
+}
+
+std::unique_ptr<AST::Program> load_text(std::string text, std::string filename) {
+    auto file = sources.add(std::move(text), filename);
+    auto sc = scanner(file);
+    auto prog = parse(&sc);
+    sc.Free();
+    analyze(prog.get());
+    return prog;
+}
+
+void load_body(AST::FuncDecl *fd) {
+    // bodies of one program share its arena
+    static std::mutex lock;
+    std::lock_guard<std::mutex> guard(lock);
+    parse_body(fd);
+    escape_analysis(fd);
+    link_body(fd);
+}
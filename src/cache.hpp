@@ -0,0 +1,30 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * precompiled module cache (.ycc)
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "ast.hpp"
+
+// bump whenever the interpreter or the layout of a .ycc file changes
+#define YC_VERSION "0.2"
+#define YCC_FORMAT 6
+
+// Loads, parses and analyzes a source file. A valid .ycc next to the
+// source (or under $YC_CACHE_DIR) is read instead of parsing, otherwise
+// one is written for the next run. Set YC_NO_CACHE to bypass it.
+// With `lazy`, function bodies are left to load_body() unless YC_EAGER is
+// set, so syntax errors inside them only show up once they are called.
+extern std::unique_ptr<AST::Program> load_program(std::string path, std::string filename, bool lazy = false);
+
+// parses and analyzes source text, without a cache
+extern std::unique_ptr<AST::Program> load_text(std::string text, std::string filename);
+
+// parses and analyzes a lazily loaded function body
+extern void load_body(AST::FuncDecl *fd);
@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#include "channel.hpp"
+
+#include <chrono>
+
+#include "ast.hpp"
+#include "task.hpp"
+
+void Channel::release(void) {
+    if (--refs != 0)
+        return;
+    for (auto&& vt : items)
+        delete vt;
+    delete this;
+}
+
+void Channel::send(AST::ValueType *vt) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        items.push_back(vt);
+    }
+    ready.notify_one();
+}
+
+bool Channel::waiting(void) {
+    std::lock_guard<std::mutex> guard(lock);
+    return !items.empty();
+}
+
+AST::ValueType *Channel::recv(const std::atomic<bool> &stop) {
+    std::unique_lock<std::mutex> guard(lock);
+    if (items.empty()) {
+        // the sender may be queued behind the worker running this
+        guard.unlock();
+        Blocking blocking;
+        guard.lock();
+        // nothing signals `stop`, look at it now and then
+        while (!ready.wait_for(guard, std::chrono::milliseconds(50),
+            [this] { return !items.empty(); })) {
+            if (stop)
+                return nullptr;
+        }
+    }
+    auto vt = items.front();
+    items.pop_front();
+    return vt;
+}
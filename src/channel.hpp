@@ -0,0 +1,45 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * channels carrying values between threads
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace AST {
+class ValueType;
+}
+
+// An unbounded queue of values, shared by every variable holding it on
+// any thread; the last one to let go deletes it with whatever it still
+// holds. Values pass through it as they are, send() takes them over.
+class Channel {
+ private:
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<AST::ValueType *> items;
+    std::atomic<int> refs{1};
+
+ public:
+    Channel() {}
+    Channel(const Channel &) = delete;
+    Channel& operator= (const Channel &) = delete;
+
+    Channel *share(void) {
+        refs++;
+        return this;
+    }
+    void release(void);
+
+    void send(AST::ValueType *vt);
+    // whether a value is waiting
+    bool waiting(void);
+    // waits for a value, nullptr once `stop` is set
+    AST::ValueType *recv(const std::atomic<bool> &stop);
+};
@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#include "charclass.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+/**
+ * Scalar kernels - portable fallback
+ */
+static const char *skip_space_scalar(const char *p, const char *end) {
+    while ((p < end) && is_space(*p)) p++;
+    return p;
+}
+
+static const char *skip_ident_scalar(const char *p, const char *end) {
+    while ((p < end) && is_ident(*p)) p++;
+    return p;
+}
+
+static const char *find_quote_scalar(const char *p, const char *end) {
+    while ((p < end) && (*p != '"') && (*p != '\\')) p++;
+    return p;
+}
+
+// libc already vectorises memchr, every kernel set shares it
+static const char *find_newline_scalar(const char *p, const char *end) {
+    auto nl = static_cast<const char *>(memchr(p, '\n', end - p));
+    return (nl == nullptr) ? end : nl;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+/**
+ * SSE2 kernels - 16 bytes per step
+ */
+#define SSE2 __attribute__((target("sse2")))
+
+// lanes of x within [lo, hi], using a biased signed compare
+SSE2 static inline __m128i in_range16(__m128i x, char lo, char hi) {
+    auto t = _mm_add_epi8(x, _mm_set1_epi8((char)(0x80 - lo)));
+    return _mm_cmplt_epi8(t, _mm_set1_epi8((char)(-128 + (hi - lo + 1))));
+}
+
+SSE2 static inline __m128i space16(__m128i x) {
+    return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+                        in_range16(x, '\t', '\r'));
+}
+
+SSE2 static inline __m128i ident16(__m128i x) {
+    auto lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    auto m = _mm_or_si128(in_range16(lower, 'a', 'z'), in_range16(x, '0', '9'));
+    return _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+}
+
+SSE2 static inline __m128i quote16(__m128i x) {
+    return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('"')),
+                        _mm_cmpeq_epi8(x, _mm_set1_epi8('\\')));
+}
+
+#define SPAN16(fn, classify, stop_on_match, scalar)                         \
+    SSE2 static const char *fn(const char *p, const char *end) {           \
+        while (end - p >= 16) {                                            \
+            auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); \
+            unsigned mask = _mm_movemask_epi8(classify(x));                \
+            if (!(stop_on_match)) mask = ~mask & 0xFFFF;                    \
+            if (mask != 0) return p + __builtin_ctz(mask);                 \
+            p += 16;                                                       \
+        }                                                                  \
+        return scalar(p, end);                                             \
+    }
+
+SPAN16(skip_space_sse2, space16, false, skip_space_scalar)
+SPAN16(skip_ident_sse2, ident16, false, skip_ident_scalar)
+SPAN16(find_quote_sse2, quote16, true, find_quote_scalar)
+
+/**
+ * AVX2 kernels - 32 bytes per step
+ */
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i in_range32(__m256i x, char lo, char hi) {
+    auto t = _mm256_add_epi8(x, _mm256_set1_epi8((char)(0x80 - lo)));
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + (hi - lo + 1))), t);
+}
+
+AVX2 static inline __m256i space32(__m256i x) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+                           in_range32(x, '\t', '\r'));
+}
+
+AVX2 static inline __m256i ident32(__m256i x) {
+    auto lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    auto m = _mm256_or_si256(in_range32(lower, 'a', 'z'), in_range32(x, '0', '9'));
+    return _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+}
+
+AVX2 static inline __m256i quote32(__m256i x) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')),
+                           _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\')));
+}
+
+#define SPAN32(fn, classify, stop_on_match, tail)                              \
+    AVX2 static const char *fn(const char *p, const char *end) {              \
+        while (end - p >= 32) {                                               \
+            auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); \
+            unsigned mask = _mm256_movemask_epi8(classify(x));                \
+            if (!(stop_on_match)) mask = ~mask;                                \
+            if (mask != 0) return p + __builtin_ctz(mask);                    \
+            p += 32;                                                          \
+        }                                                                     \
+        return tail(p, end);                                                  \
+    }
+
+SPAN32(skip_space_avx2, space32, false, skip_space_sse2)
+SPAN32(skip_ident_avx2, ident32, false, skip_ident_sse2)
+SPAN32(find_quote_avx2, quote32, true, find_quote_sse2)
+
+#endif  // HAVE_X86_KERNELS
+
+static const ScanKernels scalar_kernels = {
+    "scalar", skip_space_scalar, skip_ident_scalar, find_quote_scalar, find_newline_scalar
+};
+
+#ifdef HAVE_X86_KERNELS
+static const ScanKernels sse2_kernels = {
+    "sse2", skip_space_sse2, skip_ident_sse2, find_quote_sse2, find_newline_scalar
+};
+
+static const ScanKernels avx2_kernels = {
+    "avx2", skip_space_avx2, skip_ident_avx2, find_quote_avx2, find_newline_scalar
+};
+#endif
+
+static const ScanKernels *select_kernels(void) {
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return & avx2_kernels;
+    if (__builtin_cpu_supports("sse2"))
+        return & sse2_kernels;
+#endif
+    return & scalar_kernels;
+}
+
+const ScanKernels *scan_kernels(void) {
+    static const ScanKernels *selected = select_kernels();
+    return selected;
+}
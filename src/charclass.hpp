@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * character classes and span kernels used by the scanner
+ */
+
+#pragma once
+
+#include <cstdint>
+
+enum char_class : uint8_t {
+    cc_space = 1,   // ' ', \t, \n, \v, \f, \r
+    cc_digit = 2,   // 0-9
+    cc_alpha = 4,   // a-z, A-Z, _
+};
+
+struct CharTable {
+    uint8_t v[256];
+};
+
+constexpr CharTable make_char_table(void) {
+    CharTable t{};
+    for (int c = 0; c < 256; ++c) {
+        uint8_t k = 0;
+        if ((c == ' ') || ((c >= '\t') && (c <= '\r')))
+            k |= cc_space;
+        if ((c >= '0') && (c <= '9'))
+            k |= cc_digit;
+        if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || (c == '_'))
+            k |= cc_alpha;
+        t.v[c] = k;
+    }
+    return t;
+}
+
+// locale independent replacement for <cctype>
+inline constexpr CharTable char_table = make_char_table();
+
+inline bool is_space(char c) { return char_table.v[(uint8_t)c] & cc_space; }
+inline bool is_digit(char c) { return char_table.v[(uint8_t)c] & cc_digit; }
+inline bool is_alpha(char c) { return char_table.v[(uint8_t)c] & cc_alpha; }
+inline bool is_ident(char c) { return char_table.v[(uint8_t)c] & (cc_alpha | cc_digit); }
+
+// Each kernel returns the first position in [p, end) that stops the span,
+// or end. The widest implementation the CPU supports is picked at runtime.
+struct ScanKernels {
+    const char *name;
+    const char *(*skip_space)(const char *p, const char *end);
+    const char *(*skip_ident)(const char *p, const char *end);
+    const char *(*find_quote)(const char *p, const char *end);  // '"' or '\\'
+    const char *(*find_newline)(const char *p, const char *end);
+};
+
+extern const ScanKernels *scan_kernels(void);
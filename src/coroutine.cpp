@@ -0,0 +1,342 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#include "coroutine.hpp"
+
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <new>
+
+#include "ast.hpp"
+#include "task.hpp"
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/common_interface_defs.h>
+#define YC_ASAN_FIBERS
+#endif
+#if defined(__SANITIZE_THREAD__)
+#include <sanitizer/tsan_interface.h>
+#define YC_TSAN_FIBERS
+#endif
+
+namespace {
+
+// the interpreter recurses once per call and statement, mapped lazily
+const size_t stack_size = 2 << 20;
+
+// stacks of coroutines that returned, for the next ones on the thread
+class Stacks {
+ private:
+    static const size_t kept = 16;
+    std::vector<char *> free;
+    // values held by thread_local interpreters may go after this
+    static thread_local bool gone;
+
+ public:
+    ~Stacks() {
+        for (auto&& s : free)
+            munmap(s, stack_size);
+        gone = true;
+    }
+
+    char *get(void) {
+        if (!gone && !free.empty()) {
+            auto s = free.back();
+            free.pop_back();
+            return s;
+        }
+        auto s = mmap(nullptr, stack_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (s == MAP_FAILED)
+            throw std::bad_alloc();
+        // overflowing it faults instead of running into other memory
+        mprotect(s, sysconf(_SC_PAGESIZE), PROT_NONE);
+        return static_cast<char *>(s);
+    }
+
+    void put(char *s) {
+        if (!gone && (free.size() < kept))
+            free.push_back(s);
+        else
+            munmap(s, stack_size);
+    }
+};
+
+thread_local bool Stacks::gone = false;
+thread_local Stacks stacks;
+
+}  // namespace
+
+struct Coroutine::Context {
+    ucontext_t self;
+    ucontext_t *caller = nullptr;
+    char *stack = nullptr;
+#ifdef YC_ASAN_FIBERS
+    void *fake_stack = nullptr;
+    const void *caller_bottom = nullptr;
+    size_t caller_size = 0;
+#endif
+#ifdef YC_TSAN_FIBERS
+    void *fiber = nullptr;
+    void *caller_fiber = nullptr;
+#endif
+
+    // from the resumer into the coroutine, and back once it suspends
+    void enter(void) {
+        ucontext_t back;
+        caller = &back;
+#ifdef YC_ASAN_FIBERS
+        void *fake = nullptr;
+        __sanitizer_start_switch_fiber(&fake, stack, stack_size);
+#endif
+#ifdef YC_TSAN_FIBERS
+        caller_fiber = __tsan_get_current_fiber();
+        __tsan_switch_to_fiber(fiber, 0);
+#endif
+        swapcontext(&back, &self);
+#ifdef YC_ASAN_FIBERS
+        __sanitizer_finish_switch_fiber(fake, nullptr, nullptr);
+#endif
+    }
+
+    // from the coroutine back to its resumer, for good once it returned
+    void leave(bool last) {
+#ifdef YC_ASAN_FIBERS
+        __sanitizer_start_switch_fiber(last ? nullptr : &fake_stack, caller_bottom, caller_size);
+#endif
+#ifdef YC_TSAN_FIBERS
+        __tsan_switch_to_fiber(caller_fiber, 0);
+#endif
+        swapcontext(&self, caller);
+        entered();
+    }
+
+    // first thing on the coroutine stack after every switch to it
+    void entered(void) {
+#ifdef YC_ASAN_FIBERS
+        __sanitizer_finish_switch_fiber(fake_stack, &caller_bottom, &caller_size);
+#endif
+    }
+};
+
+thread_local Coroutine *Coroutine::active = nullptr;
+
+Coroutine::Coroutine(std::function<void(void)> body) :
+    context(std::make_unique<Context>()), body(std::move(body)),
+    thread(std::this_thread::get_id()) {}
+
+Coroutine::~Coroutine() {
+    this->cancel();
+    auto c = this->context.get();
+    if (c->stack == nullptr)
+        return;
+    if (!this->finished) {
+        // suspended on another thread, its stack may still be referred to
+        return;
+    }
+#ifdef YC_TSAN_FIBERS
+    __tsan_destroy_fiber(c->fiber);
+#endif
+    stacks.put(c->stack);
+}
+
+void Coroutine::entry(unsigned int hi, unsigned int lo) {
+    auto co = reinterpret_cast<Coroutine *>((static_cast<uintptr_t>(hi) << 32) | lo);
+    co->context->entered();
+    try {
+        co->body();
+    } catch (Cancel &) {
+        // unwound on purpose
+    } catch (...) {
+        co->error = std::current_exception();
+    }
+    co->finished = true;
+    co->context->leave(true);
+}
+
+void Coroutine::resume(void) {
+    if (this->finished || this->running)
+        return;
+    auto c = this->context.get();
+    if (c->stack == nullptr) {
+        c->stack = stacks.get();
+        getcontext(&c->self);
+        c->self.uc_stack.ss_sp = c->stack;
+        c->self.uc_stack.ss_size = stack_size;
+        c->self.uc_link = nullptr;
+        auto p = reinterpret_cast<uintptr_t>(this);
+        makecontext(&c->self, reinterpret_cast<void (*)(void)>(&Coroutine::entry), 2,
+            static_cast<unsigned int>(p >> 32), static_cast<unsigned int>(p));
+#ifdef YC_TSAN_FIBERS
+        c->fiber = __tsan_create_fiber(0);
+#endif
+    }
+    // each side keeps its own interpreter of the thread
+    AST::Interpreter::Scope keep(AST::Interpreter::current());
+    this->outer = active;
+    active = this;
+    this->running = true;
+    c->enter();
+    this->running = false;
+    active = this->outer;
+    if (this->error) {
+        auto e = this->error;
+        this->error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+void Coroutine::suspend(void) {
+    auto co = active;
+    {
+        AST::Interpreter::Scope keep(AST::Interpreter::current());
+        co->context->leave(false);
+    }
+    if (co->cancelled)
+        throw Cancel();
+}
+
+void Coroutine::cancel(void) {
+    if ((this->context->stack == nullptr) || this->finished || this->running || !this->local())
+        return;
+    this->cancelled = true;
+    this->resume();
+}
+
+namespace {
+
+class AsyncCall : public Coroutine {
+ private:
+    AST::Interpreter *top;
+    AST::FuncDecl *fd;
+    std::unique_ptr<AST::SymTable> st;
+
+    void run(void) {
+        AST::ValueType *vt = nullptr;
+        try {
+            vt = this->top->invoke(this->fd, this->st.get(), this);
+        } catch (Coroutine::Cancel &) {
+            // whoever awaits it learns why, the program itself goes on
+            this->task->complete(nullptr, std::make_exception_ptr(InterpreterException(
+                this->fd->name.str() + ": the async call was cancelled", this->fd)));
+            this->top->finish(nullptr);
+            throw;
+        } catch (...) {
+            auto e = std::current_exception();
+            this->task->complete(nullptr, e);
+            this->top->finish(e);
+            return;
+        }
+        this->task->complete(vt, nullptr);
+        this->top->finish(nullptr);
+    }
+
+ public:
+    AST::Interpreter *creator;
+    Task *task;
+    std::function<bool(void)> ready;  // what it waits for, while suspended
+
+    AsyncCall(AST::Interpreter *creator, AST::FuncDecl *fd, std::unique_ptr<AST::SymTable> st,
+        Task *task) : Coroutine([this] { run(); }), top(creator->top()), fd(fd),
+        st(std::move(st)), creator(creator), task(task) {}
+
+    ~AsyncCall() {
+        this->cancel();
+        this->task->release();
+    }
+};
+
+// the async calls of this thread that are not done
+thread_local std::vector<AsyncCall *> calls;
+
+void resume(AsyncCall *call) {
+    call->ready = nullptr;
+    // the call completes its task with whatever it throws
+    call->resume();
+    if (!call->done())
+        return;
+    calls.erase(std::find(calls.begin(), calls.end(), call));
+    delete call;
+}
+
+// resumes the calls that can go on, false if none could
+bool step(void) {
+    bool ran = false;
+    // the list changes as they run
+    for (size_t i = 0; i < calls.size(); ++i) {
+        auto call = calls[i];
+        if (call->busy() || !call->ready || !call->ready())
+            continue;
+        resume(call);
+        ran = true;
+    }
+    return ran;
+}
+
+// nothing here can go on, what the calls wait for comes from other threads
+void idle(void) {
+    Blocking blocking;
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+}  // namespace
+
+Task *async_call(AST::FuncDecl *fd, std::vector<AST::ValueType *> args) {
+    auto in = AST::Interpreter::current();
+    auto top = in->top();
+    auto st = top->bind(fd, std::move(args));
+    top->hold();
+    auto task = new Task(top);
+    auto call = new AsyncCall(in, fd, std::move(st), task->share());
+    calls.push_back(call);
+    resume(call);
+    return task;
+}
+
+bool async_pending(void) {
+    return !calls.empty();
+}
+
+bool async_wait(const std::function<bool(void)> &ready, const std::atomic<bool> &stop) {
+    auto call = dynamic_cast<AsyncCall *>(AST::Interpreter::current()->coroutine);
+    while (!ready()) {
+        if (stop)
+            return false;
+        if (call != nullptr) {
+            call->ready = [&ready, &stop] { return stop || ready(); };
+            Coroutine::suspend();
+        } else if (!step()) {
+            idle();
+        }
+    }
+    return true;
+}
+
+void async_drain(AST::Interpreter *in) {
+    auto made = [in] (AsyncCall *call) { return call->creator == in; };
+    while (std::any_of(calls.begin(), calls.end(), made))
+        if (!step())
+            idle();
+}
+
+void async_cancel(AST::Interpreter *in) {
+    size_t i = 0;
+    while (i < calls.size()) {
+        auto call = calls[i];
+        if ((call->creator != in) || call->busy()) {
+            ++i;
+            continue;
+        }
+        calls.erase(calls.begin() + i);
+        // the calls it made go with it, start over
+        delete call;
+        i = 0;
+    }
+}
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * coroutines, and the async calls running on them
+ */
+
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace AST {
+class ValueType;
+class FuncDecl;
+class Interpreter;
+}
+class Task;
+
+// A call running on a stack of its own: suspend() leaves it where it
+// stands and goes back to whoever resumed it, the next resume() goes on
+// from there. Only the thread that made it runs it. Dropping it while it
+// is suspended unwinds its stack, suspend() throwing Cancel.
+class Coroutine {
+ private:
+    struct Context;
+    std::unique_ptr<Context> context;
+    std::function<void(void)> body;
+    std::thread::id thread;
+    bool running = false;
+    bool finished = false;
+    bool cancelled = false;
+    std::exception_ptr error;
+    Coroutine *outer = nullptr;  // the one that resumed it, if any
+
+    static thread_local Coroutine *active;
+    static void entry(unsigned int hi, unsigned int lo);
+
+ public:
+    struct Cancel {};
+
+    explicit Coroutine(std::function<void(void)> body);
+    Coroutine(const Coroutine &) = delete;
+    Coroutine& operator= (const Coroutine &) = delete;
+    virtual ~Coroutine();
+
+    // runs it until it suspends or returns, and rethrows what the body threw
+    void resume(void);
+    // unwinds it if suspended; a derived class calls it before its own
+    // members go, one dropped on another thread is left as it is
+    void cancel(void);
+    bool done(void) const { return finished; }
+    // resumed and not suspended since, maybe resuming another one
+    bool busy(void) const { return running; }
+    bool local(void) const { return thread == std::this_thread::get_id(); }
+
+    // suspends the coroutine running on the calling thread
+    static void suspend(void);
+    static Coroutine *current(void) { return active; }
+};
+
+// A call of an async function starts at once on the calling thread, and
+// runs as a coroutine until it waits; the task it returns is done once
+// the call returned. Calls suspended on a thread go on, one at a time,
+// whenever code on that thread waits, and before the interpreter that
+// made them returns.
+extern Task *async_call(AST::FuncDecl *fd, std::vector<AST::ValueType *> args);
+// the calling thread has async calls that are not done
+extern bool async_pending(void);
+// Waits until `ready` holds, false if `stop` is set first. An async call
+// is suspended meanwhile, other code runs the async calls of the thread.
+extern bool async_wait(const std::function<bool(void)> &ready, const std::atomic<bool> &stop);
+// runs the async calls `in` made to their end
+extern void async_drain(AST::Interpreter *in);
+// cancels the async calls `in` made, as it failed
+extern void async_cancel(AST::Interpreter *in);
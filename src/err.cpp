@@ -8,12 +8,18 @@
 #include <sstream>
 #include <iostream>
 
-const char *InterpreterException::what() const throw() {
+std::string InterpreterException::describe(void) const {
     std::stringstream ss;
-    if (ast)
-        ss << "File \"" << ast->filename << "\" " << ast->row << ':' << ast->col << ": " << ast->line << std::endl;
+    if ((ast != nullptr) && (ast->loc != 0)) {
+        auto info = sources.resolve(ast->loc);
+        ss << "File \"" << info.filename << "\" " << info.row << ':' << info.col << ": " << info.line << std::endl;
+    }
     ss << "AST Error: " << message << std::endl;
-    std::cout << ss.str();
+    return ss.str();
+}
+
+const char *InterpreterException::what() const throw() {
+    std::cout << describe();
     return "";
 }
 
@@ -10,14 +10,14 @@
 
 #include "scanner.hpp"
 
+// where a node came from, resolved to file, row and line text on error only
 class ErrInfo {
  public:
-    int row;
-    int col;
-    std::string line;
-    std::string filename;
+    SourceLoc loc = 0;
     ErrInfo() {}
-    explicit ErrInfo(scanner *Scanner) : row(Scanner->row), col(Scanner->col), line(Scanner->line), filename(Scanner->filename) {}
+    explicit ErrInfo(SourceLoc l) : loc(l) {}
+    // implicit, so nodes are built straight from the scanner position
+    ErrInfo(scanner *Scanner) : loc(Scanner->loc()) {}
 };
 
 class InterpreterException : public std::exception {
@@ -30,6 +30,8 @@ class InterpreterException : public std::exception {
     virtual ~InterpreterException() throw() {}
 
     virtual const char* what() const throw();
+    // the location and the message, as what() prints them
+    std::string describe(void) const;
 };
 
 extern std::string err_type_mismatch(
@@ -0,0 +1,146 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#include "generator.hpp"
+
+#include <fstream>
+#include <memory>
+#include <utility>
+
+#include "ast.hpp"
+#include "coroutine.hpp"
+#include "runtime.hpp"
+
+namespace {
+
+// the body of a generator function, up to its next yield at a time
+class FunctionGenerator : public Generator, public Coroutine {
+ private:
+    AST::Interpreter *top;
+    std::unique_ptr<AST::SymTable> st;
+
+    void run(void) {
+        auto ret = this->top->invoke(this->fd, this->st.get(), this);
+        if ((ret->ms.size() == 0) && (ret != & AST::None))
+            delete ret;
+    }
+
+ protected:
+    void advance(void) override {
+        if (!this->local())
+            throw InterpreterException(this->fd->name.str() +
+                ": a generator runs on the thread that made it only", this->fd);
+        if (this->busy())
+            throw InterpreterException(this->fd->name.str() +
+                ": the generator asks itself for a value", this->fd);
+        try {
+            this->resume();
+        } catch (...) {
+            this->ended = true;
+            throw;
+        }
+        if (this->done())
+            this->ended = true;
+    }
+
+ public:
+    AST::FuncDecl *fd;
+
+    FunctionGenerator(AST::Interpreter *top, AST::FuncDecl *fd, std::unique_ptr<AST::SymTable> st) :
+        Coroutine([this] { run(); }), top(top), st(std::move(st)), fd(fd) {}
+
+    ~FunctionGenerator() {
+        this->cancel();
+    }
+
+    void put(AST::ValueType *vt) {
+        this->value = vt;
+        Coroutine::suspend();
+    }
+};
+
+class RangeGenerator : public Generator {
+ private:
+    int at, hi;
+
+ protected:
+    void advance(void) override {
+        if (at < hi)
+            this->value = new AST::ValueType(at++, false);
+        else
+            this->ended = true;
+    }
+
+ public:
+    RangeGenerator(int lo, int hi) : at(lo), hi(hi) {}
+};
+
+class LinesGenerator : public Generator {
+ private:
+    std::ifstream in;
+
+ protected:
+    void advance(void) override {
+        std::string line;
+        if (std::getline(in, line))
+            this->value = new AST::ValueType(new std::string(line), false);
+        else
+            this->ended = true;
+    }
+
+ public:
+    explicit LinesGenerator(const std::string &path) : in(path) {}
+    bool opened(void) const { return in.is_open(); }
+};
+
+}  // namespace
+
+Generator::~Generator() {
+    if (this->value != nullptr)
+        delete this->value;
+}
+
+bool Generator::more(void) {
+    if ((this->value == nullptr) && !this->ended)
+        this->advance();
+    return this->value != nullptr;
+}
+
+AST::ValueType *Generator::next(void) {
+    this->more();
+    auto vt = this->value;
+    this->value = nullptr;
+    return vt;
+}
+
+Generator *Generator::call(AST::FuncDecl *fd, std::vector<AST::ValueType *> args) {
+    auto top = AST::Interpreter::current()->top();
+    return new FunctionGenerator(top, fd, top->bind(fd, std::move(args)));
+}
+
+Generator *Generator::range(int lo, int hi) {
+    return new RangeGenerator(lo, hi);
+}
+
+Generator *Generator::lines(const std::string &path) {
+    auto g = new LinesGenerator(path);
+    if (!g->opened()) {
+        delete g;
+        return nullptr;
+    }
+    return g;
+}
+
+void Generator::yield(AST::ValueType *vt, AST::YieldExpr *at) {
+    auto g = dynamic_cast<FunctionGenerator *>(AST::Interpreter::current()->coroutine);
+    if (g == nullptr)
+        throw InterpreterException("yield: not in the body of a generator", at);
+    auto& item = g->fd->ret;
+    if ((vt == & AST::None) || (!g->fd->genType.valid && (vt->type != item)))
+        throw InterpreterException(err_type_mismatch("yield", item.str(), vt->type.str()), at);
+    // the value moves out, as with send
+    runtime_take_over(vt);
+    g->put(vt);
+}
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * generators, making their values one at a time as they are asked for
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace AST {
+class ValueType;
+class FuncDecl;
+class YieldExpr;
+}
+
+// The values of a generator<T>, each made once asked for: by a call of a
+// generator function, which runs as a coroutine up to its next yield, or
+// by a builtin source. Owned by the value holding it.
+class Generator {
+ protected:
+    AST::ValueType *value = nullptr;  // made, not taken yet
+    bool ended = false;
+
+    // makes the next value, or sets `ended`
+    virtual void advance(void) = 0;
+
+ public:
+    Generator() {}
+    Generator(const Generator &) = delete;
+    Generator& operator= (const Generator &) = delete;
+    virtual ~Generator();
+
+    // whether there is a next value, making it if need be; rethrows what
+    // the generator function threw
+    bool more(void);
+    // hands over the next value, nullptr after the last one
+    AST::ValueType *next(void);
+
+    // a call of a generator function, which binds the arguments as
+    // Interpreter::bind() does and runs nothing yet
+    static Generator *call(AST::FuncDecl *fd, std::vector<AST::ValueType *> args);
+    // int32 from lo up to hi, hi excluded
+    static Generator *range(int lo, int hi);
+    // the lines of a file without their '\n', nullptr if it cannot be read
+    static Generator *lines(const std::string &path);
+
+    // hands `vt` over to whoever asked the generator running the body for
+    // a value, and returns once the next one is asked for
+    static void yield(AST::ValueType *vt, AST::YieldExpr *at);
+};
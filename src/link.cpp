@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * link step, run once the imported modules are declared
+ */
+
+#include "link.hpp"
+
+#include <vector>
+
+#include "err.hpp"
+#include "runtime.hpp"
+
+namespace {
+
+// mirrors SymTable::lookup, but only through declarations: a variable in
+// between may be rebound, so such a name is left to the lookup
+AST::MemStore *resolve(const AST::Name &n) {
+    if (n.ClassName.empty())
+        return nullptr;
+    auto tbl = runtime_module(n.ClassName[0]);
+    if (tbl == nullptr)
+        return nullptr;
+    try {
+        for (size_t i = 1; i < n.ClassName.size(); ++i) {
+            auto vt = tbl->lookup(AST::Name(n.ClassName[i]), nullptr)->get();
+            if ((vt->type.baseType == AST::t_rtfn) &&
+                (i + 1 == n.ClassName.size()) && (n.BaseName == "new")) {
+                // constructors are declared next to their class
+                AST::Name cl(n.ClassName[i]);
+                return tbl->lookup(AST::Name(&cl, n.BaseName), nullptr);
+            }
+            if ((!vt->isConst) || (vt->type.baseType != AST::t_class) ||
+                (vt->type.arrayT != 0))
+                return nullptr;
+            tbl = vt->data.st;
+        }
+        return tbl->lookup(AST::Name(n.BaseName), nullptr);
+    } catch (InterpreterException &) {
+        // reported where it is evaluated, if it ever is
+        return nullptr;
+    }
+}
+
+void link(AST::EvalExpr *e);
+
+void link(AST::ExprVal *v) {
+    if (v->isConst)
+        return;
+    if (v->call != nullptr) {
+        v->call->linked = resolve(v->call->function);
+        for (auto&& par : v->call->pars)
+            link(par);
+    } else {
+        v->linked = resolve(v->refName);
+    }
+    if (v->array != nullptr)
+        link(v->array);
+}
+
+void link(AST::EvalExpr *e) {
+    if (e == nullptr)
+        return;
+    if (e->isVal) {
+        link(e->val);
+        return;
+    }
+    link(e->l);
+    link(e->r);
+}
+
+void link(std::vector<AST::Expr *> *exprs) {
+    for (auto&& expr : *exprs) {
+        switch (expr->exprType) {
+            case AST::e_var:
+                link(static_cast<AST::VarDecl *>(expr)->init);
+                break;
+            case AST::e_eval:
+                link(static_cast<AST::EvalExpr *>(expr));
+                break;
+            case AST::e_if: {
+                auto ie = static_cast<AST::IfExpr *>(expr);
+                link(ie->cond);
+                link(&ie->iftrue);
+                link(&ie->iffalse);
+                break;
+            }
+            case AST::e_while: {
+                auto we = static_cast<AST::WhileExpr *>(expr);
+                link(we->cond);
+                link(&we->exprs);
+                break;
+            }
+            case AST::e_for: {
+                auto fe = static_cast<AST::ForExpr *>(expr);
+                link(fe->init);
+                link(fe->cond);
+                link(fe->step);
+                link(&fe->exprs);
+                break;
+            }
+            case AST::e_match: {
+                auto me = static_cast<AST::MatchExpr *>(expr);
+                link(me->var);
+                for (auto&& line : me->lines)
+                    link(&line.exprs);
+                break;
+            }
+            case AST::e_ret:
+                link(static_cast<AST::RetExpr *>(expr)->stmt);
+                break;
+            case AST::e_yield:
+                link(static_cast<AST::YieldExpr *>(expr)->stmt);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void link(std::vector<AST::GlobalStatement *> *stmts) {
+    for (auto&& stmt : *stmts) {
+        switch (stmt->stmtType) {
+            case AST::gs_var:
+                link(static_cast<AST::VarDecl *>(stmt)->init);
+                break;
+            case AST::gs_func:
+                link_body(static_cast<AST::FuncDecl *>(stmt));
+                break;
+            case AST::gs_class:
+                link(&static_cast<AST::ClassDecl *>(stmt)->stmts);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+}  // namespace
+
+void link_program(AST::Program *prog) {
+    link(&prog->stmts);
+}
+
+// a body not parsed yet is linked by load_body()
+void link_body(AST::FuncDecl *fd) {
+    link(&fd->exprs);
+}
@@ -0,0 +1,14 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#pragma once
+
+#include "ast.hpp"
+
+// binds every qualified name that starts at an imported module, such as
+// types.Optional.None, straight to its storage in the module, so that
+// evaluating it skips the lookup through each component
+extern void link_program(AST::Program *prog);
+extern void link_body(AST::FuncDecl *fd);
@@ -4,34 +4,34 @@
  */
 
 #include <iostream>
-#include <fstream>
 #include <filesystem>
 
-#include "scanner.hpp"
-#include "parser.hpp"
 #include "ast.hpp"
 #include "err.hpp"
+#include "cache.hpp"
+#include "batch.hpp"
+#include "serve.hpp"
 
 namespace fs = std::filesystem;
 
 int main(int argc, char** argv) {
-    std::filebuf file;
     fs::path path;
+    if ((argc > 2) && (std::string(argv[1]) == "--serve")) {
+        return serve(argv[2]);
+    }
+    if ((argc > 1) && (std::string(argv[1]) == "--batch")) {
+        return batch(std::vector<std::string>(argv + 2, argv + argc));
+    }
     if (argc > 1) {
         path = fs::path(argv[1]);
-        if (!file.open(argv[1], std::ios::in))
-            std::runtime_error("open() error: " + std::string(argv[1]));
     } else {
         path = fs::path("./input.yc");
-        if (!file.open("input.yc", std::ios::in))
-            std::runtime_error("open() error: input.yc");
     }
-    auto result_scanner = scanner(&file, path.filename().string());
-    auto result_ast = parse(result_scanner);
-    result_scanner.Free();
+    auto result_ast = load_program(path.string(), path.filename().string());
     // result_ast->print();
 
-    AST::interpret(std::move(*result_ast));
+    AST::Interpreter interpreter;
+    interpreter.run(std::move(*result_ast));
 
     return 0;
 }
@@ -0,0 +1,198 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "analysis.hpp"
+#include "err.hpp"
+#include "pool.hpp"
+
+namespace {
+
+thread_local bool in_iteration = false;
+
+// indices [next, end) a thread has still to run
+struct Range {
+    std::mutex lock;
+    int64_t next = 0, end = 0;
+};
+
+class Loop {
+ private:
+    AST::ForExpr *fe;
+    const AST::SymTable *st;
+    std::vector<Range> ranges;
+
+    std::mutex lock;
+    std::condition_variable finished;
+    size_t running = 0;
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+
+    bool take(size_t p, int64_t *k) {
+        auto& own = ranges[p];
+        {
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (own.next < own.end) {
+                *k = own.next++;
+                return true;
+            }
+        }
+        for (size_t i = 1; i < ranges.size(); ++i) {
+            auto& victim = ranges[(p + i) % ranges.size()];
+            int64_t begin, end;
+            {
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if (victim.next >= victim.end)
+                    continue;
+                begin = victim.next + (victim.end - victim.next) / 2;
+                end = victim.end;
+                victim.end = begin;
+            }
+            std::lock_guard<std::mutex> guard(own.lock);
+            own.next = begin + 1;
+            own.end = end;
+            *k = begin;
+            return true;
+        }
+        return false;
+    }
+
+ public:
+    Loop(AST::ForExpr *fe, const AST::SymTable *st, size_t threads, int64_t lo, int64_t hi) :
+        fe(fe), st(st), ranges(threads) {
+        for (size_t p = 0; p < threads; ++p) {
+            ranges[p].next = lo + (hi - lo) * p / threads;
+            ranges[p].end = lo + (hi - lo) * (p + 1) / threads;
+        }
+    }
+
+    void work(size_t p) {
+        // flags and frames of its own, the tables around the loop are shared
+        AST::Interpreter in;
+        AST::Interpreter::Scope scope(&in);
+        auto outer = in_iteration;
+        in_iteration = true;
+
+        AST::SymTable view(st, st->depth());
+        auto base = view.depth();
+        view.addLayer();
+        try {
+            int64_t k;
+            while (!failed && take(p, &k)) {
+                view.insert(fe->index, new AST::ValueType(static_cast<int>(k), false));
+                for (auto&& expr : fe->exprs) {
+                    expr->interpret(&view);
+                    if (in.continue_flag)
+                        break;
+                }
+                in.continue_flag = 0;
+            }
+        } catch (...) {
+            while (view.depth() > base + 1)
+                view.removeLayer();
+            while (in.frames.depth() > 0)
+                in.frames.leave(nullptr);
+            std::lock_guard<std::mutex> guard(lock);
+            if (!error)
+                error = std::current_exception();
+            failed = true;
+        }
+        in_iteration = outer;
+    }
+
+    void run(ThreadPool *pool) {
+        running = ranges.size() - 1;
+        for (size_t p = 1; p < ranges.size(); ++p) {
+            pool->submit([this, p] {
+                work(p);
+                std::lock_guard<std::mutex> guard(lock);
+                if (--running == 0)
+                    finished.notify_all();
+            });
+        }
+        work(0);
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [this] { return running == 0; });
+        if (error)
+            std::rethrow_exception(error);
+    }
+};
+
+// an element held by other variables too would have every iteration
+// writing it update their shared records, it gets a value of its own
+void own_elements(AST::ForExpr *fe, AST::SymTable *st, int64_t lo, int64_t hi) {
+    for (auto&& n : fe->arrays) {
+        auto arr = st->lookup(n, fe)->get();
+        if (arr->type.arrayT == 0)
+            throw InterpreterException("parallel for: " + n.str() + " is not an array", fe);
+        for (int64_t k = std::max<int64_t>(lo, 0); k < std::min<int64_t>(hi, arr->type.arrayT); ++k) {
+            auto ms = &arr->data.vt[k];
+            auto vt = ms->get();
+            if ((vt == nullptr) || (vt->ms.size() <= 1))
+                continue;
+            AST::ValueType *copy;
+            switch (vt->type.baseType) {
+                case AST::t_bool: case AST::t_char: case AST::t_uint8:
+                case AST::t_int32: case AST::t_fp32: case AST::t_fp64:
+                    copy = new AST::ValueType(*vt);
+                    copy->ms.clear();
+                    copy->inFrame = false;
+                    break;
+                case AST::t_str:
+                    copy = new AST::ValueType(new std::string(*vt->data.str), vt->isConst);
+                    break;
+                default:
+                    throw InterpreterException("parallel for: " + n.str() + "[" +
+                        std::to_string(k) + "] is shared with another variable", fe);
+            }
+            copy->ms.push_back(ms);
+            ms->set(copy);
+        }
+    }
+}
+
+}  // namespace
+
+AST::ValueType *run_parallel(AST::ForExpr *fe, AST::SymTable *st) {
+    std::call_once(fe->checked, parallel_check, fe, st);
+
+    fe->init->interpret(st);
+    auto index = fe->init->l->val;
+    auto first = st->lookup(index)->get();
+    if (first->type != AST::IntType)
+        throw InterpreterException("parallel for: the index must be int32", fe);
+    auto bound = fe->cond->r->interpret(st);
+    if (bound->type != AST::IntType) {
+        if ((bound->ms.size() == 0) && (bound != & AST::None))
+            delete bound;
+        throw InterpreterException("parallel for: the bound must be int32", fe);
+    }
+    int64_t lo = first->data.ival;
+    int64_t hi = static_cast<int64_t>(bound->data.ival) + ((fe->cond->op == le) ? 1 : 0);
+    if (bound->ms.size() == 0)
+        delete bound;
+    hi = std::max(lo, hi);
+
+    if (lo < hi) {
+        own_elements(fe, st, lo, hi);
+        static ThreadPool pool(pool_threads());
+        size_t threads = in_iteration ? 1 : pool.size();
+        threads = static_cast<size_t>(std::min<int64_t>(threads, hi - lo));
+        Loop loop(fe, st, threads, lo, hi);
+        loop.run(&pool);
+    }
+    // the index ends where a sequential loop leaves it
+    st->update(index, new AST::ValueType(static_cast<int>(hi), false));
+    return & AST::None;
+}
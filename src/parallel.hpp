@@ -0,0 +1,18 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * parallel for loops on a work-stealing scheduler
+ */
+
+#pragma once
+
+#include "ast.hpp"
+
+// Runs a `parallel for` once parallel_check() accepted it. The bounds are
+// evaluated once, then each thread of a shared pool starts on its own
+// share of the indices and, when done, steals half of what another one
+// has left. Iterations see the variables around the loop through a
+// private view of `st`. Loops nested in an iteration run on its thread.
+// YC_THREADS sets the size of the pool, one per hardware thread otherwise.
+extern AST::ValueType *run_parallel(AST::ForExpr *fe, AST::SymTable *st);
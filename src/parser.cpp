@@ -15,107 +15,168 @@
 #include "util.hpp"
 #include "err.hpp"
 
-static token input_token;
+// all state of one parse, so several files can be parsed at once
+class Parser {
+ private:
+    scanner *Scanner;
+    token input_token;
+    AST::Arena *arena = nullptr;  // arena of the program being parsed
+    bool lazy = false;
+    bool yielded = false;  // the body being parsed has a yield
+
+    template<typename T, typename... Args>
+    T *node(Args&&... args) {
+        return arena->make<T>(std::forward<Args>(args)...);
+    }
 
-inline bool error(scanner *Scanner, std::string prompt) {
+    bool error(std::string prompt);
+    std::string_view match(token expected);
+
+    std::unique_ptr<AST::Program> statements(void);
+    AST::GlobalStatement *statement(void);
+    AST::FuncDecl *func_decl(void);
+    AST::GenericDecl generic(void);
+    int array(void);
+    std::vector<AST::Param> params_decl(void);
+    AST::TypeDecl ret_decl(void);
+    AST::TypeDecl type_name(void);
+    AST::EvalExpr *init_def(void);
+    AST::VarDecl *var_def(void);
+    AST::EnumDecl *enum_def(AST::Name *parent);
+    AST::VarDecl *const_def(void);
+    AST::IfExpr *if_expr(void);
+    AST::ForExpr *for_expr(void);
+    AST::WhileExpr *while_expr(void);
+    std::vector<AST::MatchLine> match_line(void);
+    AST::MatchExpr *match_expr(void);
+    AST::RetExpr *ret_expr(void);
+    AST::YieldExpr *yield_expr(void);
+    AST::Expr *expr(void);
+    std::vector<AST::Expr *> expr_list(void);
+    AST::Name name_space(void);
+
+    // binary operations, one level per precedence
+    AST::EvalExpr *e_pars(void);
+    AST::EvalExpr *e_mul_div_(AST::EvalExpr *l);
+    AST::EvalExpr *e_mul_div(void);
+    AST::EvalExpr *e_add_sub_(AST::EvalExpr *l);
+    AST::EvalExpr *e_add_sub(void);
+    AST::EvalExpr *e_lgte_(AST::EvalExpr *l);
+    AST::EvalExpr *e_lgte(void);
+    AST::EvalExpr *e_eq_neq_(AST::EvalExpr *l);
+    AST::EvalExpr *e_eq_neq(void);
+    AST::EvalExpr *e_band(AST::EvalExpr *l);
+    AST::EvalExpr *e_bitwise_and(void);
+    AST::EvalExpr *e_bxor(AST::EvalExpr *l);
+    AST::EvalExpr *e_bitwise_xor(void);
+    AST::EvalExpr *e_bor(AST::EvalExpr *l);
+    AST::EvalExpr *e_bitwise_or(void);
+    AST::EvalExpr *e_land(AST::EvalExpr *l);
+    AST::EvalExpr *e_logical_and(void);
+    AST::EvalExpr *e_lor(AST::EvalExpr *l);
+    AST::EvalExpr *e_logical_or(void);
+    AST::EvalExpr *e_assign(AST::EvalExpr *l);
+    AST::EvalExpr *eval_expr(void);
+
+ public:
+    Parser(scanner *Scanner, bool lazy) : Scanner(Scanner), input_token(t_eof), lazy(lazy) {}
+    Parser(scanner *Scanner, AST::Arena *arena) : Scanner(Scanner), input_token(t_eof), arena(arena) {}
+    std::unique_ptr<AST::Program> parse(void);
+    void body(AST::FuncDecl *fd);
+};
+
+bool Parser::error(std::string prompt) {
     std::cerr << "Error  (Parser): at line " << Scanner->row << ":" << Scanner->col << std::endl
-            << Scanner->line << std::endl
+            << Scanner->line() << std::endl
             << "\t" << prompt << " cannot accept "
-            << terms[input_token] << "(" << Scanner->data << ")" << std::endl;
+            << terms[input_token] << "(" << Scanner->text() << ")" << std::endl;
     throw std::runtime_error("Parser Error");
 }
 
-std::string match(scanner *Scanner, token expected) {
+// the returned text points into the source buffer
+std::string_view Parser::match(token expected) {
     if (input_token == expected) {
-        std::string result = Scanner->data;
+        auto result = Scanner->text();
 
         if (expected != t_eof)
             input_token = Scanner->scan();
 
         return result;
     } else {
-        error(Scanner, "Terminal \"" + terms[expected] + '"');
+        error("Terminal \"" + terms[expected] + '"');
         return "E";
     }
 }
 
-std::unique_ptr<AST::Program> statements(scanner *Scanner);
-std::unique_ptr<AST::GlobalStatement> statement(scanner *Scanner);
-std::unique_ptr<AST::FuncDecl> func_decl(scanner *Scanner);
-AST::GenericDecl generic(scanner *Scanner);
-int array(scanner *Scanner);
-std::vector<AST::Param> params_decl(scanner *Scanner);
-AST::TypeDecl ret_decl(scanner *Scanner);
-AST::TypeDecl type_name(scanner *Scanner);
-std::vector<std::unique_ptr<AST::Expr>> expr_list(scanner *Scanner);
-std::unique_ptr<AST::EvalExpr> eval_expr(scanner *Scanner);
-std::unique_ptr<AST::VarDecl> var_def(scanner *Scanner);
-std::unique_ptr<AST::EnumDecl> enum_def(scanner *Scanner, AST::Name *parent);
-std::unique_ptr<AST::VarDecl> const_def(scanner *Scanner);
-AST::Name name_space(scanner *Scanner);
-
-std::unique_ptr<AST::Program> statements(scanner *Scanner) {
+std::unique_ptr<AST::Program> Parser::statements(void) {
     std::unique_ptr<AST::Program> program = std::make_unique<AST::Program>(Scanner);
+    arena = program->arena.get();
     while (input_token == t_import) {
-        match(Scanner, t_import);
-        match(Scanner, lpar);
-        auto path = match(Scanner, t_str);
-        match(Scanner, rpar);
-        match(Scanner, eol);
+        match(t_import);
+        match(lpar);
+        auto path = unescape(match(t_str));
+        match(rpar);
+        match(eol);
         program->imports.push_back(path);
     }
     while (input_token != t_eof) {
-        auto gs = statement(Scanner);
+        auto gs = statement();
         if (gs != nullptr)
-            program->insert(std::move(gs));
+            program->insert(gs);
     }
     return program;
 }
 
-std::unique_ptr<AST::GlobalStatement> statement(scanner *Scanner) {
+AST::GlobalStatement *Parser::statement(void) {
     switch (input_token) {
         case t_fn: {
-            return func_decl(Scanner);
+            return func_decl();
+        }
+        case t_async: {
+            match(t_async);
+            auto fd = func_decl();
+            fd->is_async = true;
+            return fd;
         }
         case t_var: {
-            auto vd = var_def(Scanner);
+            auto vd = var_def();
             vd->is_global = true;
             return vd;
         }
         case t_const: {
-            auto cd = const_def(Scanner);
+            auto cd = const_def();
             cd->is_global = true;
             return cd;
         }
         case t_class: {
-            match(Scanner, t_class);
-            auto cn = match(Scanner, t_name);
-            auto gen = generic(Scanner);
-            match(Scanner, lbra);
-            auto cl = std::make_unique<AST::ClassDecl>(Scanner, cn, gen);
+            match(t_class);
+            auto cn = std::string(match(t_name));
+            auto gen = generic();
+            match(lbra);
+            auto cl = node<AST::ClassDecl>(Scanner, cn, gen);
             while ((input_token == t_const) ||
                    (input_token == t_var) ||
                    (input_token == t_fn)) {
                 // class domain
-                auto clstmt = statement(Scanner);
+                auto clstmt = statement();
                 if (clstmt != nullptr) {
-                    cl->stmts.push_back(std::move(clstmt));
+                    cl->stmts.push_back(clstmt);
                 }
             }
-            match(Scanner, rbra);
+            match(rbra);
             return cl;
         }
         case t_union: {
-            match(Scanner, t_union);
-            auto un = AST::Name(match(Scanner, t_name));
-            auto gen = generic(Scanner);
-            match(Scanner, lbra);
-            auto u = std::make_unique<AST::UnionDecl>(Scanner, un, gen);
+            match(t_union);
+            auto un = AST::Name(std::string(match(t_name)));
+            auto gen = generic();
+            match(lbra);
+            auto u = node<AST::UnionDecl>(Scanner, un, gen);
             while (input_token == t_enum) {
-                auto cl = enum_def(Scanner, &un);
-                u->classes.push_back(std::move(cl));
+                auto cl = enum_def(&un);
+                u->classes.push_back(cl);
             }
-            match(Scanner, rbra);
+            match(rbra);
             return u;
         }
         default: {
@@ -124,42 +185,55 @@ std::unique_ptr<AST::GlobalStatement> statement(scanner *Scanner) {
     }
 }
 
-std::unique_ptr<AST::EnumDecl> enum_def(scanner *Scanner, AST::Name *parent) {
-    match(Scanner, t_enum);
-    auto en = match(Scanner, t_name);
-    auto e = std::make_unique<AST::EnumDecl>(Scanner, AST::Name(parent, en));
-    match(Scanner, lbra);
+AST::EnumDecl *Parser::enum_def(AST::Name *parent) {
+    match(t_enum);
+    auto en = std::string(match(t_name));
+    auto e = node<AST::EnumDecl>(Scanner, AST::Name(parent, en));
+    match(lbra);
     while (input_token == t_var) {
-        auto vd = var_def(Scanner);
-        e->vars.push_back(std::move(vd));
+        auto vd = var_def();
+        e->vars.push_back(vd);
     }
-    match(Scanner, rbra);
+    match(rbra);
     return e;
 }
 
-std::unique_ptr<AST::FuncDecl> func_decl(scanner *Scanner) {
-    match(Scanner, t_fn);
-    auto n = match(Scanner, t_name);
-    auto gen = generic(Scanner);
-    match(Scanner, lpar);
-    auto prms = params_decl(Scanner);
-    match(Scanner, rpar);
-    auto ret_type = ret_decl(Scanner);
-    match(Scanner, lbra);
-    auto exprs = expr_list(Scanner);
-    match(Scanner, rbra);
-    auto fn = std::make_unique<AST::FuncDecl>(
+AST::FuncDecl *Parser::func_decl(void) {
+    match(t_fn);
+    auto n = std::string(match(t_name));
+    auto gen = generic();
+    match(lpar);
+    auto prms = params_decl();
+    match(rpar);
+    auto ret_type = ret_decl();
+    if (lazy && (input_token == lbra)) {
+        int row;
+        auto body = Scanner->skip_block(&row);
+        input_token = Scanner->scan();
+        auto fn = node<AST::FuncDecl>(
+            Scanner, AST::Name(n), gen, prms, ret_type);
+        fn->body = body;
+        fn->body_row = row;
+        fn->arena = arena;
+        return fn;
+    }
+    match(lbra);
+    yielded = false;
+    auto exprs = expr_list();
+    match(rbra);
+    auto fn = node<AST::FuncDecl>(
         Scanner, AST::Name(n), gen, prms, ret_type);
     for (auto&& e : exprs)
-        fn->exprs.push_back(std::move(e));
+        fn->exprs.push_back(e);
+    fn->generator = yielded;
     return fn;
 }
 
-AST::GenericDecl generic(scanner *Scanner) {
+AST::GenericDecl Parser::generic(void) {
     if (input_token == lt) {
-        match(Scanner, lt);
-        auto gen_name = name_space(Scanner);
-        match(Scanner, gt);
+        match(lt);
+        auto gen_name = name_space();
+        match(gt);
         return AST::GenericDecl(Scanner, gen_name);
     } else {
         // epsilon
@@ -167,273 +241,301 @@ AST::GenericDecl generic(scanner *Scanner) {
     }
 }
 
-int array(scanner *Scanner) {
+int Parser::array(void) {
     int v = 0;
     if (input_token == larr) {
-        match(Scanner, larr);
-        v = std::stoi(match(Scanner, t_int));
-        match(Scanner, rarr);
+        match(larr);
+        v = std::stoi(std::string(match(t_int)));
+        match(rarr);
     }  // else: epsilon
     return v;
 }
 
-std::vector<AST::Param> params_decl(scanner *Scanner) {
+std::vector<AST::Param> Parser::params_decl(void) {
     std::vector<AST::Param> prms;
     if (input_token == t_name) {
-        auto par_name = match(Scanner, t_name);
-        match(Scanner, colon);
-        auto tn = type_name(Scanner);
+        auto par_name = std::string(match(t_name));
+        match(colon);
+        auto tn = type_name();
         prms.push_back(AST::Param(Scanner, par_name, tn));
         while (input_token == comma) {
-            match(Scanner, comma);
-            auto par_name = match(Scanner, t_name);
-            match(Scanner, colon);
-            auto tn = type_name(Scanner);
+            match(comma);
+            auto par_name = std::string(match(t_name));
+            match(colon);
+            auto tn = type_name();
             prms.push_back(AST::Param(Scanner, par_name, tn));
         }
     }
     return prms;
 }
 
-AST::TypeDecl ret_decl(scanner *Scanner) {
+AST::TypeDecl Parser::ret_decl(void) {
     if (input_token == colon) {
-        match(Scanner, colon);
-        return type_name(Scanner);
+        match(colon);
+        return type_name();
     } else {
         // epsilon
         return AST::VoidType;
     }
 }
 
-AST::TypeDecl type_name(scanner *Scanner) {
+AST::TypeDecl Parser::type_name(void) {
     AST::Types base = AST::t_void;
     AST::Name other;
     switch (input_token) {
         case type_void:
             base = AST::t_void;
-            match(Scanner, input_token);
+            match(input_token);
             break;
         case type_bool:
             base = AST::t_bool;
-            match(Scanner, input_token);
+            match(input_token);
             break;
         case type_char:
             base = AST::t_char;
-            match(Scanner, input_token);
+            match(input_token);
             break;
         case type_fp32:
             base = AST::t_fp32;
-            match(Scanner, input_token);
+            match(input_token);
             break;
         case type_fp64:
             base = AST::t_fp64;
-            match(Scanner, input_token);
+            match(input_token);
             break;
         case type_int32:
             base = AST::t_int32;
-            match(Scanner, input_token);
+            match(input_token);
             break;
         case type_uint8:
             base = AST::t_uint8;
-            match(Scanner, input_token);
+            match(input_token);
             break;
         case type_str:
             base = AST::t_str;
-            match(Scanner, input_token);
+            match(input_token);
             break;
+        case type_chan:
+        case type_future:
+        case type_generator: {
+            // chan<T>, future<T> and generator<T>, T written as its name
+            base = (input_token == type_chan) ? AST::t_chan :
+                (input_token == type_future) ? AST::t_future : AST::t_generator;
+            match(input_token);
+            match(lt);
+            auto gen = AST::GenericDecl(Scanner, AST::Name(type_name().str()));
+            match(gt);
+            auto arr = array();
+            return AST::TypeDecl(Scanner, base, other, gen, arr);
+        }
         case t_name: {
             base = AST::t_class;
-            other = name_space(Scanner);
+            other = name_space();
             break;
         }
         default:
-            error(Scanner, "type() rejects");
+            error("type() rejects");
     }
-    auto gen = generic(Scanner);
-    auto arr = array(Scanner);
+    auto gen = generic();
+    auto arr = array();
     return AST::TypeDecl(Scanner, base, other, gen, arr);
 }
 
-std::unique_ptr<AST::EvalExpr> init_def(scanner *Scanner) {
+AST::EvalExpr *Parser::init_def(void) {
     if (input_token == move) {
-        match(Scanner, move);
-        return eval_expr(Scanner);
+        match(move);
+        return eval_expr();
     } else {
         // epsilon
         return nullptr;
     }
 }
 
-std::unique_ptr<AST::VarDecl> var_def(scanner *Scanner) {
-    match(Scanner, t_var);
-    auto vn = match(Scanner, t_name);
-    match(Scanner, colon);
-    auto tn = type_name(Scanner);
-    auto init = init_def(Scanner);
-    match(Scanner, eol);
-    return std::make_unique<AST::VarDecl>(
-        Scanner, vn, tn, std::move(init));
-}
-
-std::unique_ptr<AST::VarDecl> const_def(scanner *Scanner) {
-    match(Scanner, t_const);
-    auto cn = match(Scanner, t_name);
-    match(Scanner, move);
-    auto init = eval_expr(Scanner);
-    match(Scanner, eol);
-    auto cd = std::make_unique<AST::VarDecl>(
-        Scanner, cn, AST::VoidType, std::move(init));
+AST::VarDecl *Parser::var_def(void) {
+    match(t_var);
+    auto vn = std::string(match(t_name));
+    match(colon);
+    auto tn = type_name();
+    auto init = init_def();
+    match(eol);
+    return node<AST::VarDecl>(
+        Scanner, vn, tn, init);
+}
+
+AST::VarDecl *Parser::const_def(void) {
+    match(t_const);
+    auto cn = std::string(match(t_name));
+    match(move);
+    auto init = eval_expr();
+    match(eol);
+    auto cd = node<AST::VarDecl>(
+        Scanner, cn, AST::VoidType, init);
     cd->is_const = true;
     return cd;
 }
 
-std::unique_ptr<AST::IfExpr> if_expr(scanner *Scanner) {
-    match(Scanner, t_if);
-    match(Scanner, lpar);
-    auto cond = eval_expr(Scanner);
-    match(Scanner, rpar);
-    match(Scanner, lbra);
-    auto iftrue = expr_list(Scanner);
-    match(Scanner, rbra);
+AST::IfExpr *Parser::if_expr(void) {
+    match(t_if);
+    match(lpar);
+    auto cond = eval_expr();
+    match(rpar);
+    match(lbra);
+    auto iftrue = expr_list();
+    match(rbra);
     if (input_token == t_else) {
         // if-then-else
-        match(Scanner, t_else);
-        match(Scanner, lbra);
-        auto iffalse = expr_list(Scanner);
-        match(Scanner, rbra);
-        auto if_expr = std::make_unique<AST::IfExpr>(
-            Scanner, std::move(cond));
+        match(t_else);
+        match(lbra);
+        auto iffalse = expr_list();
+        match(rbra);
+        auto if_expr = node<AST::IfExpr>(
+            Scanner, cond);
         for (auto&& e : iftrue) {
-            if_expr->iftrue.push_back(std::move(e));
+            if_expr->iftrue.push_back(e);
         }
         for (auto&& e : iffalse) {
-            if_expr->iffalse.push_back(std::move(e));
+            if_expr->iffalse.push_back(e);
         }
         return if_expr;
     } else {
         // if-then
-        auto if_expr = std::make_unique<AST::IfExpr>(Scanner, std::move(cond));
+        auto if_expr = node<AST::IfExpr>(Scanner, cond);
         for (auto&& e : iftrue) {
-            if_expr->iftrue.push_back(std::move(e));
+            if_expr->iftrue.push_back(e);
         }
         return if_expr;
     }
 }
 
-std::unique_ptr<AST::ForExpr> for_expr(scanner *Scanner) {
-    match(Scanner, t_for);
-    match(Scanner, lpar);
-    auto init = eval_expr(Scanner);
-    match(Scanner, eol);
-    auto cond = eval_expr(Scanner);
-    match(Scanner, eol);
-    auto step = eval_expr(Scanner);
-    match(Scanner, rpar);
-    match(Scanner, lbra);
-    auto es = expr_list(Scanner);
-    match(Scanner, rbra);
-    auto fe = std::make_unique<AST::ForExpr>(
-        Scanner, std::move(init), std::move(cond), std::move(step));
+AST::ForExpr *Parser::for_expr(void) {
+    bool parallel = (input_token == t_parallel);
+    if (parallel)
+        match(t_parallel);
+    match(t_for);
+    match(lpar);
+    auto init = eval_expr();
+    match(eol);
+    auto cond = eval_expr();
+    match(eol);
+    auto step = eval_expr();
+    match(rpar);
+    match(lbra);
+    auto es = expr_list();
+    match(rbra);
+    auto fe = node<AST::ForExpr>(
+        Scanner, init, cond, step);
+    fe->parallel = parallel;
     for (auto&& e : es) {
-        fe->exprs.push_back(std::move(e));
+        fe->exprs.push_back(e);
     }
     return fe;
 }
 
-std::unique_ptr<AST::WhileExpr> while_expr(scanner *Scanner) {
-    match(Scanner, t_while);
-    match(Scanner, lpar);
-    auto cond = eval_expr(Scanner);
-    match(Scanner, rpar);
-    match(Scanner, lbra);
-    auto exprs = expr_list(Scanner);
-    match(Scanner, rbra);
-    auto we = std::make_unique<AST::WhileExpr>(
-        Scanner, std::move(cond));
+AST::WhileExpr *Parser::while_expr(void) {
+    match(t_while);
+    match(lpar);
+    auto cond = eval_expr();
+    match(rpar);
+    match(lbra);
+    auto exprs = expr_list();
+    match(rbra);
+    auto we = node<AST::WhileExpr>(
+        Scanner, cond);
     for (auto&& e : exprs) {
-        we->exprs.push_back(std::move(e));
+        we->exprs.push_back(e);
     }
     return we;
 }
 
-std::vector<AST::MatchLine> match_line(scanner *Scanner) {
+std::vector<AST::MatchLine> Parser::match_line(void) {
     std::vector<AST::MatchLine> lines;
     while (input_token == t_name) {
-        std::string enum_name = match(Scanner, t_name);
+        std::string enum_name(match(t_name));
         std::string opt_name = "";
         if (input_token == lpar) {
-            match(Scanner, lpar);
-            opt_name = match(Scanner, t_name);
-            match(Scanner, rpar);
+            match(lpar);
+            opt_name = match(t_name);
+            match(rpar);
         }
         auto ml = AST::MatchLine(Scanner, enum_name, opt_name);
-        match(Scanner, lbra);
-        ml.exprs = expr_list(Scanner);
-        match(Scanner, rbra);
+        match(lbra);
+        ml.exprs = expr_list();
+        match(rbra);
         lines.push_back(std::move(ml));
     }
     return lines;
 }
 
-std::unique_ptr<AST::MatchExpr> match_expr(scanner *Scanner) {
-    match(Scanner, t_match);
-    match(Scanner, lpar);
-    auto expr = eval_expr(Scanner);
-    match(Scanner, rpar);
-    match(Scanner, lbra);
-    auto lines = match_line(Scanner);
-    match(Scanner, rbra);
-    auto me = std::make_unique<AST::MatchExpr>(
-        Scanner, std::move(expr));
+AST::MatchExpr *Parser::match_expr(void) {
+    match(t_match);
+    match(lpar);
+    auto expr = eval_expr();
+    match(rpar);
+    match(lbra);
+    auto lines = match_line();
+    match(rbra);
+    auto me = node<AST::MatchExpr>(
+        Scanner, expr);
     for (auto&& line : lines) {
         me->lines.push_back(std::move(line));
     }
     return me;
 }
 
-std::unique_ptr<AST::RetExpr> ret_expr(scanner *Scanner) {
-    match(Scanner, t_return);
-    auto expr = eval_expr(Scanner);
-    match(Scanner, eol);
-    return std::make_unique<AST::RetExpr>(Scanner, std::move(expr));
+AST::RetExpr *Parser::ret_expr(void) {
+    match(t_return);
+    auto expr = eval_expr();
+    match(eol);
+    return node<AST::RetExpr>(Scanner, expr);
 }
 
-std::unique_ptr<AST::Expr> expr(scanner *Scanner) {
+AST::YieldExpr *Parser::yield_expr(void) {
+    match(t_yield);
+    auto expr = eval_expr();
+    match(eol);
+    yielded = true;
+    return node<AST::YieldExpr>(Scanner, expr);
+}
+
+AST::Expr *Parser::expr(void) {
     switch (input_token) {
             case t_var:
-                return var_def(Scanner);
+                return var_def();
             case t_const:
-                return const_def(Scanner);
+                return const_def();
             case t_if:
-                return if_expr(Scanner);
+                return if_expr();
             case t_for:
-                return for_expr(Scanner);
+            case t_parallel:
+                return for_expr();
             case t_while:
-                return while_expr(Scanner);
+                return while_expr();
             case t_match:
-                return match_expr(Scanner);
+                return match_expr();
             case t_return:
-                return ret_expr(Scanner);
+                return ret_expr();
+            case t_yield:
+                return yield_expr();
             case t_continue:
-                match(Scanner, t_continue);
-                match(Scanner, eol);
-                return std::make_unique<AST::ContExpr>(Scanner);
+                match(t_continue);
+                match(eol);
+                return node<AST::ContExpr>(Scanner);
             case t_break:
-                match(Scanner, t_break);
-                match(Scanner, eol);
-                return std::make_unique<AST::BreakExpr>(Scanner);
+                match(t_break);
+                match(eol);
+                return node<AST::BreakExpr>(Scanner);
             case eol:
                 // empty expression
-                match(Scanner, eol);
-                return std::make_unique<AST::Expr>();
+                match(eol);
+                return node<AST::Expr>();
             case t_int:
             case t_float:
             case t_str:
             case t_char:
             case t_name:
             case lpar: {
-                auto ee = eval_expr(Scanner);
-                match(Scanner, eol);
+                auto ee = eval_expr();
+                match(eol);
                 return ee;
             }
             default:
@@ -442,17 +544,19 @@ std::unique_ptr<AST::Expr> expr(scanner *Scanner) {
         }
 }
 
-std::vector<std::unique_ptr<AST::Expr>> expr_list(scanner *Scanner) {
-    std::vector<std::unique_ptr<AST::Expr>> result;
+std::vector<AST::Expr *> Parser::expr_list(void) {
+    std::vector<AST::Expr *> result;
     while (1) {
         switch (input_token) {
             case t_var:
             case t_const:
             case t_if:
             case t_for:
+            case t_parallel:
             case t_while:
             case t_match:
             case t_return:
+            case t_yield:
             case t_continue:
             case t_break:
             case eol:
@@ -462,7 +566,7 @@ std::vector<std::unique_ptr<AST::Expr>> expr_list(scanner *Scanner) {
             case t_char:
             case t_name:
             case lpar:
-                result.push_back(expr(Scanner));
+                result.push_back(expr());
                 break;
             default:
                 // epsilon
@@ -471,12 +575,12 @@ std::vector<std::unique_ptr<AST::Expr>> expr_list(scanner *Scanner) {
     }
 }
 
-AST::Name name_space(scanner *Scanner) {
+AST::Name Parser::name_space(void) {
     std::vector<std::string> names;
-    names.push_back(match(Scanner, t_name));
+    names.emplace_back(match(t_name));
     while (input_token == dot) {
-        match(Scanner, dot);
-        names.push_back(match(Scanner, t_name));
+        match(dot);
+        names.emplace_back(match(t_name));
     }
     AST::Name n = AST::Name(names.back());
     names.pop_back();
@@ -490,82 +594,81 @@ AST::Name name_space(scanner *Scanner) {
  * parses binary operations
  **/
 
-#define DEF_EL(x) std::unique_ptr<AST::EvalExpr> x(scanner *Scanner)
-#define DEF_ER(x) std::unique_ptr<AST::EvalExpr> x(\
-    scanner *Scanner, std::unique_ptr<AST::EvalExpr> l)
+#define DEF_EL(x) AST::EvalExpr *Parser::x(void)
+#define DEF_ER(x) AST::EvalExpr *Parser::x(AST::EvalExpr *l)
 
 DEF_EL(e_pars) {
     switch (input_token) {
         case t_int: {
-            auto val_str = match(Scanner, t_int);
-            auto val = std::make_unique<AST::ExprVal>(
+            auto val_str = std::string(match(t_int));
+            auto val = node<AST::ExprVal>(
                 Scanner, val_str, AST::TypeDecl(AST::t_int32));
-            return std::make_unique<AST::EvalExpr>(Scanner, std::move(val));
+            return node<AST::EvalExpr>(Scanner, val);
         }
         case t_float: {
-            auto val_str = match(Scanner, t_float);
-            auto val = std::make_unique<AST::ExprVal>(
+            auto val_str = std::string(match(t_float));
+            auto val = node<AST::ExprVal>(
                 Scanner, val_str, AST::TypeDecl(AST::t_fp32));
-            return std::make_unique<AST::EvalExpr>(Scanner, std::move(val));
+            return node<AST::EvalExpr>(Scanner, val);
         }
         case t_char: {
-            auto val_str = match(Scanner, t_char);
-            auto val = std::make_unique<AST::ExprVal>(
+            auto val_str = unescape(match(t_char));
+            auto val = node<AST::ExprVal>(
                 Scanner, val_str, AST::TypeDecl(AST::t_char));
-            return std::make_unique<AST::EvalExpr>(Scanner, std::move(val));
+            return node<AST::EvalExpr>(Scanner, val);
         }
         case t_str: {
-            auto raw = match(Scanner, t_str);
-            auto val = std::make_unique<AST::ExprVal>(
-                Scanner, raw, AST::TypeDecl(AST::t_str));
-            return std::make_unique<AST::EvalExpr>(Scanner, std::move(val));
+            auto str = unescape(match(t_str));
+            auto val = node<AST::ExprVal>(
+                Scanner, str, AST::TypeDecl(AST::t_str));
+            return node<AST::EvalExpr>(Scanner, val);
         }
         case t_name: {
-            auto n = name_space(Scanner);
-            std::unique_ptr<AST::FuncCall> fc = nullptr;
+            auto n = name_space();
+            AST::FuncCall *fc = nullptr;
             AST::Name gen_n;
             if (input_token == gen) {
-                match(Scanner, gen);
-                gen_n = name_space(Scanner);
-                match(Scanner, gen); 
+                match(gen);
+                gen_n = name_space();
+                match(gen); 
             }
             if (input_token == lpar) {
                 // optional function call
-                fc = std::make_unique<AST::FuncCall>(Scanner);
+                fc = node<AST::FuncCall>(Scanner);
                 fc->function = n;
                 fc->gen_val = gen_n;
-                match(Scanner, lpar);
+                match(lpar);
                 if (input_token == rpar) {
-                    match(Scanner, rpar);
+                    match(rpar);
                 } else {
-                    auto e = eval_expr(Scanner);
-                    fc->pars.push_back(std::move(e));
+                    auto e = eval_expr();
+                    fc->pars.push_back(e);
                     while (input_token == comma) {
-                        match(Scanner, comma);
-                        e = eval_expr(Scanner);
-                        fc->pars.push_back(std::move(e));
+                        match(comma);
+                        e = eval_expr();
+                        fc->pars.push_back(e);
                     }
-                    match(Scanner, rpar);
+                    match(rpar);
                 }
             }
-            std::unique_ptr<AST::EvalExpr> arr = nullptr;
+            AST::EvalExpr *arr = nullptr;
             if (input_token == larr) {
-                match(Scanner, larr);
-                arr = eval_expr(Scanner);
-                match(Scanner, rarr);
+                match(larr);
+                arr = eval_expr();
+                match(rarr);
             }
-            auto ee = std::make_unique<AST::ExprVal>(
-                Scanner, n, std::move(fc), std::move(arr));
-            return std::make_unique<AST::EvalExpr>(Scanner, std::move(ee));
+            auto ee = node<AST::ExprVal>(
+                Scanner, n, fc, arr);
+            return node<AST::EvalExpr>(Scanner, ee);
         }
         case lpar: {
-            match(Scanner, lpar);
-            auto ex = eval_expr(Scanner);
-            match(Scanner, rpar);
+            match(lpar);
+            auto ex = eval_expr();
+            match(rpar);
             return ex;
         }
         default: {
-            error(Scanner, "non-terminal <pars> rejects");
+            error("non-terminal <pars> rejects");
         }
     }
     throw;
@@ -575,11 +678,11 @@ DEF_ER(e_mul_div_) {
     if ((input_token == mul) ||
         (input_token == t_div) || (input_token == rem)) {
         auto op = input_token;
-        match(Scanner, input_token);
-        auto r = e_pars(Scanner);
-        auto ex = std::make_unique<AST::EvalExpr>(
-            Scanner, op, std::move(l), std::move(r));
-        return e_mul_div_(Scanner, std::move(ex));
+        match(input_token);
+        auto r = e_pars();
+        auto ex = node<AST::EvalExpr>(
+            Scanner, op, l, r);
+        return e_mul_div_(ex);
     } else {
         // epsilon
         return l;
@@ -587,18 +690,18 @@ DEF_ER(e_mul_div_) {
 }
 
 DEF_EL(e_mul_div) {
-    auto l = e_pars(Scanner);
-    return e_mul_div_(Scanner, std::move(l));
+    auto l = e_pars();
+    return e_mul_div_(l);
 }
 
 DEF_ER(e_add_sub_) {
     if ((input_token == add) || (input_token == sub)) {
         auto op = input_token;
-        match(Scanner, input_token);
-        auto r = e_mul_div(Scanner);
-        auto ex = std::make_unique<AST::EvalExpr>(
-            Scanner, op, std::move(l), std::move(r));
-        return e_add_sub_(Scanner, std::move(ex));
+        match(input_token);
+        auto r = e_mul_div();
+        auto ex = node<AST::EvalExpr>(
+            Scanner, op, l, r);
+        return e_add_sub_(ex);
     } else {
         // epsilon
         return l;
@@ -606,19 +709,19 @@ DEF_ER(e_add_sub_) {
 }
 
 DEF_EL(e_add_sub) {
-    auto l = e_mul_div(Scanner);
-    return e_add_sub_(Scanner, std::move(l));
+    auto l = e_mul_div();
+    return e_add_sub_(l);
 }
 
 DEF_ER(e_lgte_) {
     if ((input_token == le) || (input_token == lt) ||
         (input_token == ge) || (input_token == gt) ) {
         auto op = input_token;
-        match(Scanner, input_token);
-        auto r = e_add_sub(Scanner);
-        auto ex = std::make_unique<AST::EvalExpr>(
-            Scanner, op, std::move(l), std::move(r));
-        return e_lgte_(Scanner, std::move(ex));
+        match(input_token);
+        auto r = e_add_sub();
+        auto ex = node<AST::EvalExpr>(
+            Scanner, op, l, r);
+        return e_lgte_(ex);
     } else {
         // epsilon
         return l;
@@ -626,18 +729,18 @@ DEF_ER(e_lgte_) {
 }
 
 DEF_EL(e_lgte) {
-    auto l = e_add_sub(Scanner);
-    return e_lgte_(Scanner, std::move(l));
+    auto l = e_add_sub();
+    return e_lgte_(l);
 }
 
 DEF_ER(e_eq_neq_) {
     if ((input_token == equ) || (input_token == neq)) {
         auto op = input_token;
-        match(Scanner, input_token);
-        auto r = e_lgte(Scanner);
-        auto ex = std::make_unique<AST::EvalExpr>(
-            Scanner, op, std::move(l), std::move(r));
-        return e_eq_neq_(Scanner, std::move(ex));
+        match(input_token);
+        auto r = e_lgte();
+        auto ex = node<AST::EvalExpr>(
+            Scanner, op, l, r);
+        return e_eq_neq_(ex);
     } else {
         // epsilon
         return l;
@@ -645,17 +748,17 @@ DEF_ER(e_eq_neq_) {
 }
 
 DEF_EL(e_eq_neq) {
-    auto l = e_lgte(Scanner);
-    return e_eq_neq_(Scanner, std::move(l));
+    auto l = e_lgte();
+    return e_eq_neq_(l);
 }
 
 DEF_ER(e_band) {
     if (input_token == band) {
-        match(Scanner, band);
-        auto r = e_eq_neq(Scanner);
-        auto ex = std::make_unique<AST::EvalExpr>(
-            Scanner, band, std::move(l), std::move(r));
-        return e_band(Scanner, std::move(ex));
+        match(band);
+        auto r = e_eq_neq();
+        auto ex = node<AST::EvalExpr>(
+            Scanner, band, l, r);
+        return e_band(ex);
     } else {
         // epsilon
         return l;
@@ -663,17 +766,17 @@ DEF_ER(e_band) {
 }
 
 DEF_EL(e_bitwise_and) {
-    auto l = e_eq_neq(Scanner);
-    return e_band(Scanner, std::move(l));
+    auto l = e_eq_neq();
+    return e_band(l);
 }
 
 DEF_ER(e_bxor) {
     if (input_token == bxor) {
-        match(Scanner, bxor);
-        auto r = e_bitwise_and(Scanner);
-        auto ex = std::make_unique<AST::EvalExpr>(
-            Scanner, bxor, std::move(l), std::move(r));
-        return e_bxor(Scanner, std::move(ex));
+        match(bxor);
+        auto r = e_bitwise_and();
+        auto ex = node<AST::EvalExpr>(
+            Scanner, bxor, l, r);
+        return e_bxor(ex);
     } else {
         // epsilon
         return l;
@@ -681,17 +784,17 @@ DEF_ER(e_bxor) {
 }
 
 DEF_EL(e_bitwise_xor) {
-    auto l = e_bitwise_and(Scanner);
-    return e_bxor(Scanner, std::move(l));
+    auto l = e_bitwise_and();
+    return e_bxor(l);
 }
 
 DEF_ER(e_bor) {
     if (input_token == bor) {
-        match(Scanner, bor);
-        auto r = e_bitwise_xor(Scanner);
-        auto ex = std::make_unique<AST::EvalExpr>(
-            Scanner, bor, std::move(l), std::move(r));
-        return e_bor(Scanner, std::move(ex));
+        match(bor);
+        auto r = e_bitwise_xor();
+        auto ex = node<AST::EvalExpr>(
+            Scanner, bor, l, r);
+        return e_bor(ex);
     } else {
         // epsilon
         return l;
@@ -699,17 +802,17 @@ DEF_ER(e_bor) {
 }
 
 DEF_EL(e_bitwise_or) {
-    auto l = e_bitwise_xor(Scanner);
-    return e_bor(Scanner, std::move(l));
+    auto l = e_bitwise_xor();
+    return e_bor(l);
 }
 
 DEF_ER(e_land) {
     if (input_token == land) {
-        match(Scanner, land);
-        auto r = e_bitwise_or(Scanner);
-        auto ex = std::make_unique<AST::EvalExpr>(
-            Scanner, land, std::move(l), std::move(r));
-        return e_land(Scanner, std::move(ex));
+        match(land);
+        auto r = e_bitwise_or();
+        auto ex = node<AST::EvalExpr>(
+            Scanner, land, l, r);
+        return e_land(ex);
     } else {
         // epsilon
         return l;
@@ -717,17 +820,17 @@ DEF_ER(e_land) {
 }
 
 DEF_EL(e_logical_and) {
-    auto l = e_bitwise_or(Scanner);
-    return e_land(Scanner, std::move(l));
+    auto l = e_bitwise_or();
+    return e_land(l);
 }
 
 DEF_ER(e_lor) {
     if (input_token == lor) {
-        match(Scanner, lor);
-        auto r = e_logical_and(Scanner);
-        auto ex = std::make_unique<AST::EvalExpr>(
-            Scanner, lor, std::move(l), std::move(r));
-        return e_lor(Scanner, std::move(ex));
+        match(lor);
+        auto r = e_logical_and();
+        auto ex = node<AST::EvalExpr>(
+            Scanner, lor, l, r);
+        return e_lor(ex);
     } else {
         // epsilon
         return l;
@@ -735,25 +838,25 @@ DEF_ER(e_lor) {
 }
 
 DEF_EL(e_logical_or) {
-    auto l = e_logical_and(Scanner);
-    return e_lor(Scanner, std::move(l));
+    auto l = e_logical_and();
+    return e_lor(l);
 }
 
 DEF_ER(e_assign) {
     switch (input_token) {
         case move: {
-            match(Scanner, move);
-            auto r = e_logical_or(Scanner);
-            auto ex = std::make_unique<AST::EvalExpr>(
-                Scanner, move, std::move(l), std::move(r));
-            return e_assign(Scanner, std::move(ex));
+            match(move);
+            auto r = e_logical_or();
+            auto ex = node<AST::EvalExpr>(
+                Scanner, move, l, r);
+            return e_assign(ex);
         }
         case copy: {
-            match(Scanner, copy);
-            auto r = e_logical_or(Scanner);
-            auto ex = std::make_unique<AST::EvalExpr>(
-                Scanner, copy, std::move(l), std::move(r));
-            return e_assign(Scanner, std::move(ex));
+            match(copy);
+            auto r = e_logical_or();
+            auto ex = node<AST::EvalExpr>(
+                Scanner, copy, l, r);
+            return e_assign(ex);
         }
         default:
             // epsilon
@@ -762,11 +865,35 @@ DEF_ER(e_assign) {
 }
 
 DEF_EL(eval_expr) {
-    auto l = e_logical_or(Scanner);
-    return e_assign(Scanner, std::move(l));
+    auto l = e_logical_or();
+    return e_assign(l);
+}
+
+std::unique_ptr<AST::Program> Parser::parse(void) {
+    input_token = Scanner->scan();
+    return statements();
+}
+
+// the scanner stands at the '{', and stops at the matching '}' instead of
+// running on into the rest of the file
+void Parser::body(AST::FuncDecl *fd) {
+    input_token = Scanner->scan();
+    match(lbra);
+    auto exprs = expr_list();
+    if (input_token != rbra)
+        error("Terminal \"" + terms[rbra] + '"');
+    for (auto&& e : exprs)
+        fd->exprs.push_back(e);
+    fd->generator = yielded;
+}
+
+std::unique_ptr<AST::Program> parse(scanner *Scanner, bool lazy) {
+    return Parser(Scanner, lazy).parse();
 }
 
-std::unique_ptr<AST::Program> parse(scanner Scanner) {
-    input_token = Scanner.scan();
-    return statements(&Scanner);
+void parse_body(AST::FuncDecl *fd) {
+    auto file = sources.file(fd->body);
+    auto sc = scanner(file);
+    sc.seek(fd->body - file->base, fd->body_row);
+    Parser(&sc, fd->arena).body(fd);
 }
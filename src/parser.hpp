@@ -11,4 +11,8 @@
 #include "scanner.hpp"
 #include "ast.hpp"
 
-extern std::unique_ptr<AST::Program> parse(scanner);
+// a lazy parse only brace-matches function bodies, see parse_body()
+extern std::unique_ptr<AST::Program> parse(scanner *Scanner, bool lazy = false);
+
+// parses a body skipped by a lazy parse into the arena of its program
+extern void parse_body(AST::FuncDecl *fd);
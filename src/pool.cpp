@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#include "pool.hpp"
+
+#include <cstdlib>
+#include <string>
+#include <utility>
+
+ThreadPool::ThreadPool(unsigned int threads) {
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+    for (unsigned int i = 0; i < threads; ++i)
+        workers.emplace_back([this] { run(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (auto&& w : workers)
+        w.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.push_back(std::move(task));
+    }
+    ready.notify_one();
+}
+
+void ThreadPool::run(void) {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            ready.wait(guard, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;  // stopping, and nothing left to do
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+unsigned int pool_threads(void) {
+    auto env = std::getenv("YC_THREADS");
+    unsigned int threads = (env == nullptr) ? 0 : std::stoul(env);
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    return (threads == 0) ? 1 : threads;
+}
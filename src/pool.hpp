@@ -0,0 +1,40 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * fixed size thread pool
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+ private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex lock;
+    std::condition_variable ready;
+    bool stopping = false;
+
+    void run(void);
+
+ public:
+    // 0 picks one thread per hardware thread
+    explicit ThreadPool(unsigned int threads = 0);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool& operator= (const ThreadPool &) = delete;
+    ~ThreadPool();
+
+    // tasks must not throw, report failures through their own state
+    void submit(std::function<void()> task);
+    size_t size(void) const { return workers.size(); }
+};
+
+// YC_THREADS, or one per hardware thread when it is not set
+extern unsigned int pool_threads(void);
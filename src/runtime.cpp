@@ -5,42 +5,54 @@
 
 #include "runtime.hpp"
 
+#include <sys/stat.h>
+
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <map>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 #include <filesystem>
 
 #include "ast.hpp"
 #include "err.hpp"
-#include "scanner.hpp"
-#include "parser.hpp"
+#include "cache.hpp"
+#include "pool.hpp"
+#include "link.hpp"
 
 namespace fs = std::filesystem;
 
-static std::map<std::string, std::unique_ptr<AST::Program>> imports;
-
-void runtime_print(AST::FuncCall *call, AST::SymTable *st) {
+AST::ValueType *runtime_print(AST::FuncCall *call, AST::SymTable *st) {
+    auto in = AST::Interpreter::current();
+    std::ostringstream out;
     for (auto&& par : call->pars) {
         auto pst = par->interpret(st);
         if (pst != nullptr) {
             if (pst->type.arrayT != 0)
                 throw InterpreterException("cannot print an array", call);
             switch (pst->type.baseType) {
+            case AST::t_bool:
+                out << (pst->data.one_bit ? "true" : "false") << " ";
+                break;
             case AST::t_int32:
-                std::cout << pst->data.ival << " ";
+                out << pst->data.ival << " ";
                 break;
             case AST::t_fp32:
-                std::cout << pst->data.fval << " ";
+                out << pst->data.fval << " ";
                 break;
             case AST::t_fp64:
-                std::cout << pst->data.dval << " ";
+                out << pst->data.dval << " ";
                 break;
             case AST::t_char:
-                std::cout << pst->data.cval << " ";
+                out << pst->data.cval << " ";
                 break;
             case AST::t_str:
-                std::cout << *pst->data.str << " ";
+                out << *pst->data.str << " ";
                 break;
             default:
                 throw InterpreterException("Unsupported Type: " + pst->type.str(), call);
@@ -51,50 +63,58 @@ void runtime_print(AST::FuncCall *call, AST::SymTable *st) {
             }
         }
     }
-    std::cout << std::endl;
+    // one line at a time, whichever thread prints it
+    std::lock_guard<std::mutex> guard(in->top()->out_lock);
+    *in->out << out.str() << std::endl;
+    return & AST::None;
 }
 
-void runtime_debug(AST::FuncCall *call, AST::SymTable *st) {
+AST::ValueType *runtime_debug(AST::FuncCall *call, AST::SymTable *st) {
+    auto& out = *AST::Interpreter::current()->out;
     for (auto&& par : call->pars) {
         auto pst = par->interpret(st);
         if (pst == nullptr) {
-            std::cout << "debug(): value vanished" << std::endl;
-            return;
+            out << "debug(): value vanished" << std::endl;
+            return & AST::None;
         }
-        std::cout << "Debug info for: ";
+        out << "Debug info for: ";
         if (par->isVal) {
-            std::cout << call->line << std::endl;
+            out << sources.resolve(call->loc).line << std::endl;
         }
-        std::cout << "\tConst Flag: " << pst->isConst << std::endl;
-        std::cout << "\tReference Counter: " << pst->ms.size() << std::endl;
-        std::cout << "\tType: " << pst->type.str() << std::endl;
-        std::cout << "\tValue: ";
+        out << "\tConst Flag: " << pst->isConst << std::endl;
+        out << "\tReference Counter: " << pst->ms.size() << std::endl;
+        out << "\tType: " << pst->type.str() << std::endl;
+        out << "\tValue: ";
         if (pst != nullptr) {
             if (pst->type.arrayT != 0)
-                return;
+                return & AST::None;
             switch (pst->type.baseType) {
+            case AST::t_bool:
+                out << (pst->data.one_bit ? "true" : "false") << " ";
+                break;
             case AST::t_int32:
-                std::cout << pst->data.ival << " ";
+                out << pst->data.ival << " ";
                 break;
             case AST::t_fp32:
-                std::cout << pst->data.fval << " ";
+                out << pst->data.fval << " ";
                 break;
             case AST::t_fp64:
-                std::cout << pst->data.dval << " ";
+                out << pst->data.dval << " ";
                 break;
             case AST::t_char:
-                std::cout << pst->data.cval << " ";
+                out << pst->data.cval << " ";
                 break;
             case AST::t_str:
-                std::cout << *pst->data.str << " ";
+                out << *pst->data.str << " ";
                 break;
             default:
-                std::cout << "Unsupported Type: " << pst->type.str();
+                out << "Unsupported Type: " << pst->type.str();
                 break;
             }
         }
-        std::cout << std::endl;
+        out << std::endl;
     }
+    return & AST::None;
 }
 
 AST::ValueType *runtime_typeconv(AST::Types t, AST::FuncCall *call, AST::SymTable *st) {
@@ -239,13 +259,14 @@ AST::ValueType *runtime_enum_handler(
     if (vars->size() != call->pars.size()) {
         throw InterpreterException("enum initializer parameters do not match", call);
     }
-    AST::SymTable *enst = new AST::SymTable();
-    enst->addLayer();
+    auto clty = AST::TypeDecl(AST::t_class);
+    clty.other = vt->data.ed->name.owner();
+    clty.enum_base = vt->data.ed->name.BaseName;
     if (call->gen_val.str() != "") {
-        // associate generics
-        enst->insert(AST::Name(vt->data.ed->gen.name),
-            new AST::ValueType(call->gen_val));
+        clty.gen.valid = true;
+        clty.gen.name = call->gen_val;
     }
+    std::vector<AST::ValueType *> inits;
     for (unsigned int i = 0; i < vars->size(); ++i) {
         auto init = call->pars[i]->interpret(st);
         auto ty = (*vars)[i]->type;
@@ -259,19 +280,24 @@ AST::ValueType *runtime_enum_handler(
                 (*vars)[i]->name.str(), (*vars)[i]->type.str(), init->type.str()
             ), call);
         }
-        (*vars)[i]->interpret(enst);
-        auto ms = enst->lookup((*vars)[i]->name, call);
-        ms->set(init);
-        init->ms.push_back(ms);
+        inits.push_back(init);
     }
-    auto clty = AST::TypeDecl(AST::t_class);
-    clty.other = vt->data.ed->name.owner();
-    clty.enum_base = vt->data.ed->name.BaseName;
+
+    auto env = AST::Interpreter::current()->frames.newObject(call->in_frame, &clty);
+    AST::SymTable *enst = env->data.st;
+    enst->addLayer();
     if (call->gen_val.str() != "") {
-        clty.gen.valid = true;
-        clty.gen.name = call->gen_val;
+        // associate generics
+        enst->insert(AST::Name(vt->data.ed->gen.name),
+            new AST::ValueType(call->gen_val));
+    }
+    for (unsigned int i = 0; i < vars->size(); ++i) {
+        (*vars)[i]->interpret(enst);
+        auto ms = enst->lookup((*vars)[i]->name, call);
+        ms->set(inits[i]);
+        inits[i]->ms.push_back(ms);
     }
-    return new AST::ValueType(enst, &clty);
+    return env;
 }
 
 AST::ValueType *runtime_string_size(AST::FuncCall *call, AST::SymTable *st) {
@@ -313,7 +339,7 @@ AST::ValueType *runtime_read(AST::FuncCall *call, AST::SymTable *st) {
     return new AST::ValueType(new std::string(buffer), true);
 }
 
-void runtime_write(AST::FuncCall *call, AST::SymTable *st) {
+AST::ValueType *runtime_write(AST::FuncCall *call, AST::SymTable *st) {
     if (call->pars.size() != 2)
         throw InterpreterException(err_par_size_mismatch(
             "write(filename, data)", 2, call->pars.size()
@@ -338,142 +364,525 @@ void runtime_write(AST::FuncCall *call, AST::SymTable *st) {
     std::ofstream f(filename);
     f << data;
     f.close();
+    return & AST::None;
 }
 
-AST::ValueType *runtime_handler(
-    AST::Name fn, AST::FuncCall *call, AST::SymTable *st) {
-    if (fn.str() == "print") {
-        runtime_print(call, st);
-        return & AST::None;
-    }
-    if (fn.str() == "debug") {
-        runtime_debug(call, st);
-        return & AST::None;
-    }
-    if (fn.str() == "read") {
-        return runtime_read(call, st);
-    }
-    if (fn.str() == "write") {
-        runtime_write(call, st);
-        return & AST::None;
-    }
-    if (fn.str() == "to_char")
-        return runtime_typeconv(AST::t_char, call, st);
-    if (fn.str() == "to_uint8")
-        return runtime_typeconv(AST::t_uint8, call, st);
-    if (fn.str() == "to_int32")
-        return runtime_typeconv(AST::t_int32, call, st);
-    if (fn.str() == "to_fp32")
-        return runtime_typeconv(AST::t_fp32, call, st);
-    if (fn.str() == "to_fp64")
-        return runtime_typeconv(AST::t_fp64, call, st);
-    if (fn.str() == "__string_size")
-        return runtime_string_size(call, st);
-
-    // class constructors
-    st->addLayer();
-    AST::Name constructor_name = AST::Name(&fn, "new");
-    auto constructor = st->lookup(constructor_name, call)->get()->data.fs;
-
-    auto clty = AST::TypeDecl(AST::t_class);
-    clty.other = fn;
-    auto fnst = new AST::SymTable();
-    fnst->addLayer();
-    if (call->gen_val.str() != "") {
-        // associate generics
-        auto cl = st->lookup(fn, call)->get()->data.cd;
-        fnst->insert(AST::Name(cl->gen.name),
-            new AST::ValueType(call->gen_val));
-    }
-
-    AST::ValueType *context = new AST::ValueType(fnst, &clty);
-    st->insert(AST::Name("this"), context);
-
-    auto cl = st->lookup(fn, call)->get()->data.cd;
+void plan_construction(AST::ClassDecl *cl) {
+    auto& plan = cl->plan;
     for (auto&& stmt : cl->stmts) {
         switch (stmt->stmtType) {
             case AST::gs_var:
+                break;
             case AST::gs_func: {
-                stmt->declare(fnst, fnst);
+                // the last one declared wins, as in ClassDecl::declare
+                auto fd = static_cast<AST::FuncDecl *>(stmt);
+                if (fd->name.BaseName == "new")
+                    plan.ctor = fd;
                 break;
             }
             default:
                 throw InterpreterException("unsupported behavior", nullptr);
         }
     }
+    plan.type.other = cl->name;
+    plan.gen = cl->gen.name;
+    if (plan.ctor != nullptr)
+        for (auto&& prm : plan.ctor->pars)
+            plan.slots.push_back(AST::Name(prm.name));
+}
 
-    if (call->pars.size() != constructor->fd->pars.size()) {
+AST::ValueType *runtime_construct(
+    AST::ClassDecl *cl, AST::FuncCall *call, AST::SymTable *st) {
+    std::call_once(cl->planned, plan_construction, cl);
+    auto& plan = cl->plan;
+    if (plan.ctor == nullptr) {
+        throw InterpreterException(
+            "variable " + call->function.str() + ".new is not declared", call);
+    }
+    st->addLayer();
+
+    auto& frames = AST::Interpreter::current()->frames;
+    AST::ValueType *context = frames.newObject(call->in_frame, &plan.type);
+    auto fnst = context->data.st;
+    fnst->addLayer();
+    if (!call->gen_val.BaseName.empty()) {
+        // associate generics
+        fnst->insert(plan.gen, new AST::ValueType(call->gen_val));
+    }
+
+    st->insert(plan.self, context);
+
+    for (auto&& stmt : cl->stmts)
+        stmt->declare(fnst, fnst);
+
+    auto& pars = plan.ctor->pars;
+    if (call->pars.size() != pars.size()) {
         throw InterpreterException("new(): param number mismatch", nullptr);
     }
     for (unsigned int i = 0; i < call->pars.size(); ++i) {
         auto vt = call->pars[i]->interpret(st);
-        auto prm = constructor->fd->pars[i];
-        if (vt->type != prm.type) {
+        if (vt->type != pars[i].type) {
             throw InterpreterException(err_type_mismatch(
-                prm.name, prm.type.str(), vt->type.str()
+                pars[i].name, pars[i].type.str(), vt->type.str()
             ), call);
         }
-        st->insert(AST::Name(prm.name), vt);
+        st->insert(plan.slots[i], vt);
     }
 
-    constructor->fd->interpret(st);
+    frames.enter();
+    plan.ctor->interpret(st);
 
     for (auto&& msi : context->ms) {
         msi->set(nullptr);
     }
     context->ms.clear();
     st->removeLayer();
+    frames.leave(nullptr);
     return context;
 }
 
-#define BIND(x) st->insert(AST::Name(x), new AST::ValueType(&AST::RuntimeType, true))
+void runtime_take_over(AST::ValueType *vt) {
+    for (auto&& msi : vt->ms) {
+        msi->placehold = true;
+        msi->set(nullptr);
+        msi->placehold = false;
+    }
+    vt->ms.clear();
+    vt->isConst = false;
+}
+
+static AST::ValueType *channel(AST::EvalExpr *par, AST::FuncCall *call, AST::SymTable *st) {
+    auto vt = par->interpret(st);
+    if ((vt->type.baseType != AST::t_chan) || (vt->type.arrayT != 0))
+        throw InterpreterException(call->function.str() + ": " + vt->type.str() + " is not a channel", call);
+    return vt;
+}
+
+AST::ValueType *runtime_send(AST::FuncCall *call, AST::SymTable *st) {
+    if (call->pars.size() != 2)
+        throw InterpreterException("send: wrong number of parameters", call);
+    auto ch = channel(call->pars[0], call, st);
+    auto vt = call->pars[1]->interpret(st);
+    auto item = ch->type.gen.name.str();
+    if ((vt == & AST::None) || (vt->type.str() != item))
+        throw InterpreterException(err_type_mismatch("send", item, vt->type.str()), call);
+    if (vt->type.baseType == AST::t_generator)
+        throw InterpreterException("send: a generator stays on the thread that made it", call);
+    runtime_take_over(vt);
+    ch->data.chan->send(vt);
+    if (ch->ms.size() == 0)
+        delete ch;
+    return & AST::None;
+}
+
+AST::ValueType *runtime_recv(AST::FuncCall *call, AST::SymTable *st) {
+    if (call->pars.size() != 1)
+        throw InterpreterException("recv: wrong number of parameters", call);
+    auto ch = channel(call->pars[0], call, st);
+    auto top = AST::Interpreter::current()->top();
+    auto chan = ch->data.chan;
+    AST::ValueType *vt = nullptr;
+    // async calls of the thread run meanwhile, maybe sending it
+    if (!async_pending() || async_wait([chan] { return chan->waiting(); }, top->stopping))
+        vt = chan->recv(top->stopping);
+    if (ch->ms.size() == 0)
+        delete ch;
+    if (vt == nullptr) {
+        // most likely the thread that was to send it failed
+        if (auto error = top->spawned_error())
+            std::rethrow_exception(error);
+        throw InterpreterException("recv: the program ended while waiting", call);
+    }
+    return vt;
+}
+
+AST::ValueType *runtime_spawn(AST::FuncCall *call, AST::SymTable *st) {
+    if (call->pars.size() == 0)
+        throw InterpreterException("spawn: wrong number of parameters", call);
+    auto fn = call->pars[0]->interpret(st);
+    if ((fn->type.baseType != AST::t_fn) || (fn->type.arrayT != 0))
+        throw InterpreterException("spawn: " + fn->type.str() + " is not a function", call);
+    if (fn->data.fs->context.get() != nullptr)
+        throw InterpreterException("spawn: methods cannot run on another thread", call);
+    auto fd = fn->data.fs->fd;
+    if (call->pars.size() - 1 != fd->pars.size())
+        throw InterpreterException(err_par_size_mismatch(
+            fd->name.str(), fd->pars.size(), call->pars.size() - 1), call);
+    if (fd->body != 0)
+        std::call_once(fd->parsed, load_body, fd);
+    if (fd->generator)
+        throw InterpreterException("spawn: " + fd->name.str() + " is a generator", call);
+
+    std::vector<AST::ValueType *> args;
+    for (size_t i = 1; i < call->pars.size(); ++i) {
+        auto vt = call->pars[i]->interpret(st);
+        auto& prm = fd->pars[i - 1];
+        std::string error;
+        if (vt->type != prm.type)
+            error = err_type_mismatch(prm.name, vt->type.str(), prm.type.str());
+        else if (vt->type.baseType == AST::t_generator)
+            error = "spawn: a generator stays on the thread that made it";
+        if (!error.empty()) {
+            for (auto&& arg : args)
+                if (arg->ms.size() == 0)
+                    delete arg;
+            throw InterpreterException(error, call);
+        }
+        args.push_back(vt);
+    }
+    // the thread takes over its arguments, but shares the channels
+    for (auto&& vt : args) {
+        if ((vt->type.baseType == AST::t_chan) && (vt->type.arrayT == 0)) {
+            auto handle = new AST::ValueType((AST::SymTable *)nullptr, &vt->type);
+            handle->data.chan = vt->data.chan->share();
+            if (vt->ms.size() == 0)
+                delete vt;
+            vt = handle;
+        } else {
+            runtime_take_over(vt);
+        }
+    }
+    auto type = AST::TypeDecl(*call, AST::t_future, AST::Name(),
+        AST::GenericDecl(*call, AST::Name(fd->ret.str())), 0);
+    auto future = new AST::ValueType((AST::SymTable *)nullptr, &type);
+    future->data.task = AST::Interpreter::current()->spawn(fd, args);
+    return future;
+}
+
+AST::ValueType *runtime_await(AST::FuncCall *call, AST::SymTable *st) {
+    if (call->pars.size() != 1)
+        throw InterpreterException("await: wrong number of parameters", call);
+    auto future = call->pars[0]->interpret(st);
+    if ((future->type.baseType != AST::t_future) || (future->type.arrayT != 0))
+        throw InterpreterException("await: " + future->type.str() + " is not a future", call);
+    auto task = future->data.task;
+    if (task == nullptr)
+        throw InterpreterException("await: nothing was spawned for this future", call);
+    auto top = AST::Interpreter::current()->top();
+    // async calls of the thread run meanwhile, an async call suspends
+    bool stopped = async_pending() && !task->run() && !task->ended() &&
+        !async_wait([task] { return task->ended(); }, top->stopping);
+    // an error of the call is rethrown as it is
+    auto vt = stopped ? nullptr : task->await();
+    if (future->ms.size() == 0)
+        delete future;
+    if (stopped) {
+        if (auto error = top->spawned_error())
+            std::rethrow_exception(error);
+        throw InterpreterException("await: the program ended while waiting", call);
+    }
+    if (vt == nullptr)
+        throw InterpreterException("await: the result was taken already", call);
+    return vt;
+}
+
+static AST::ValueType *generator(AST::EvalExpr *par, AST::FuncCall *call, AST::SymTable *st) {
+    auto vt = par->interpret(st);
+    if ((vt->type.baseType != AST::t_generator) || (vt->type.arrayT != 0))
+        throw InterpreterException(call->function.str() + ": " + vt->type.str() + " is not a generator", call);
+    if (vt->data.generator == nullptr)
+        throw InterpreterException(call->function.str() + ": nothing generates for this generator", call);
+    return vt;
+}
+
+static AST::ValueType *generated(AST::FuncCall *call, const std::string &item, Generator *g) {
+    auto type = AST::TypeDecl(*call, AST::t_generator, AST::Name(),
+        AST::GenericDecl(*call, AST::Name(item)), 0);
+    auto vt = new AST::ValueType((AST::SymTable *)nullptr, &type);
+    vt->data.generator = g;
+    return vt;
+}
+
+AST::ValueType *runtime_more(AST::FuncCall *call, AST::SymTable *st) {
+    if (call->pars.size() != 1)
+        throw InterpreterException("more: wrong number of parameters", call);
+    auto g = generator(call->pars[0], call, st);
+    // runs the generator function up to its next yield, if need be
+    bool more = g->data.generator->more();
+    if (g->ms.size() == 0)
+        delete g;
+    return new AST::ValueType(more, false);
+}
+
+AST::ValueType *runtime_next(AST::FuncCall *call, AST::SymTable *st) {
+    if (call->pars.size() != 1)
+        throw InterpreterException("next: wrong number of parameters", call);
+    auto g = generator(call->pars[0], call, st);
+    auto vt = g->data.generator->next();
+    if (g->ms.size() == 0)
+        delete g;
+    if (vt == nullptr)
+        throw InterpreterException("next: the generator has no more values", call);
+    return vt;
+}
+
+AST::ValueType *runtime_range(AST::FuncCall *call, AST::SymTable *st) {
+    if (call->pars.size() != 2)
+        throw InterpreterException(err_par_size_mismatch("range(lo, hi)", 2, call->pars.size()), call);
+    int bounds[2];
+    for (int i = 0; i < 2; ++i) {
+        auto vt = call->pars[i]->interpret(st);
+        if (vt->type != AST::IntType)
+            throw InterpreterException(err_type_mismatch(
+                (i == 0) ? "lo" : "hi", AST::IntType.str(), vt->type.str()), call);
+        bounds[i] = vt->data.ival;
+        if (vt->ms.size() == 0)
+            delete vt;
+    }
+    return generated(call, "int32", Generator::range(bounds[0], bounds[1]));
+}
+
+AST::ValueType *runtime_lines(AST::FuncCall *call, AST::SymTable *st) {
+    if (call->pars.size() != 1)
+        throw InterpreterException(err_par_size_mismatch("lines(filename)", 1, call->pars.size()), call);
+    auto filename_vt = call->pars[0]->interpret(st);
+    if (filename_vt->type != AST::StrType)
+        throw InterpreterException(err_type_mismatch(
+            "filename", AST::StrType.str(), filename_vt->type.str()), call);
+    auto filename = *filename_vt->data.str;
+    if (filename_vt->ms.size() == 0)
+        delete filename_vt;
+    auto g = Generator::lines(filename);
+    if (g == nullptr)
+        throw InterpreterException("lines: cannot read " + filename, call);
+    return generated(call, "str", g);
+}
+
+template<AST::Types t>
+AST::ValueType *runtime_to(AST::FuncCall *call, AST::SymTable *st) {
+    return runtime_typeconv(t, call, st);
+}
+
+/**
+ * Builtins - a builtin is bound to its index in this table, so a call is
+ * one indirect call. read_only builtins never keep their arguments, local
+ * ones change nothing but their arguments (no I/O, no other variable).
+ */
+namespace {
+
+typedef AST::ValueType *(*BuiltinHandler)(AST::FuncCall *call, AST::SymTable *st);
+
+struct Builtin {
+    const char *name;
+    BuiltinHandler handler;
+    bool read_only;
+    bool local;
+};
+
+const Builtin builtins[] = {
+    {"print", runtime_print, true, false},
+    {"debug", runtime_debug, true, false},
+    {"to_char", runtime_to<AST::t_char>, false, true},
+    {"to_uint8", runtime_to<AST::t_uint8>, false, true},
+    {"to_int32", runtime_to<AST::t_int32>, false, true},
+    {"to_fp32", runtime_to<AST::t_fp32>, false, true},
+    {"to_fp64", runtime_to<AST::t_fp64>, false, true},
+    {"read", runtime_read, false, false},
+    {"write", runtime_write, false, false},
+    {"__string_size", runtime_string_size, false, true},
+    {"send", runtime_send, false, false},
+    {"recv", runtime_recv, false, false},
+    {"spawn", runtime_spawn, false, false},
+    {"await", runtime_await, false, false},
+    {"more", runtime_more, true, false},
+    {"next", runtime_next, true, false},
+    {"range", runtime_range, true, true},
+    {"lines", runtime_lines, true, false},
+};
+
+}  // namespace
+
+AST::ValueType *runtime_builtin(int id, AST::FuncCall *call, AST::SymTable *st) {
+    return builtins[id].handler(call, st);
+}
+
+bool runtime_read_only(const std::string &name) {
+    for (auto&& b : builtins)
+        if (name == b.name)
+            return b.read_only;
+    return false;
+}
+
+bool runtime_local(const std::string &name) {
+    for (auto&& b : builtins)
+        if (name == b.name)
+            return b.local;
+    return false;
+}
+
 void runtime_bind(AST::SymTable *st) {
-    BIND("print");
-    BIND("debug");
-    BIND("to_char");
-    BIND("to_uint8");
-    BIND("to_int32");
-    BIND("to_fp32");
-    BIND("to_fp64");
-    BIND("read");
-    BIND("write");
-    BIND("__string_size");
+    int id = 0;
+    for (auto&& b : builtins) {
+        auto vt = new AST::ValueType(&AST::BuiltinType, true);
+        vt->data.ival = id++;
+        st->insert(AST::Name(b.name), vt);
+    }
+}
+
+namespace {
+
+std::string module_name(const fs::path &file_name) {
+    auto base_name = file_name.filename().string();
+    return base_name.substr(0, base_name.find_first_of("."));
+}
+
+int64_t file_mtime(const std::string &path) {
+    struct stat sb;
+    if (stat(path.c_str(), &sb) != 0)
+        return -1;
+    return (int64_t)sb.st_mtim.tv_sec * 1000000000 + sb.st_mtim.tv_nsec;
 }
 
+struct Module {
+    std::string path;
+    std::unique_ptr<AST::Program> ast;
+    std::vector<std::string> children;  // import paths, resolved
+    bool done = false;
+    std::exception_ptr error;
+};
+
+// Scans and parses modules on a thread pool. A module schedules its own
+// imports as soon as it is parsed, so the whole import graph loads in
+// parallel while the caller declares modules in breadth first order.
+class ModuleLoader {
+ private:
+    ThreadPool *pool;
+    std::set<std::string> loaded;  // modules of earlier runs, skipped
+    std::map<std::string, std::pair<int64_t, std::unique_ptr<AST::Program>>> *spare;
+    std::map<std::string, std::unique_ptr<Module>> modules;
+    std::mutex lock;
+    std::condition_variable finished;
+    size_t pending = 0;
+
+    void load(Module *m) {
+        try {
+            auto file_name = fs::path(m->path);
+            std::pair<int64_t, std::unique_ptr<AST::Program>> kept;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                auto it = spare->find(m->path);
+                if (it != spare->end()) {
+                    kept = std::move(it->second);
+                    spare->erase(it);
+                }
+            }
+            if ((kept.second != nullptr) && (kept.first == file_mtime(m->path)))
+                m->ast = std::move(kept.second);
+            else
+                m->ast = load_program(file_name.string(), file_name.filename().string(), true);
+            // imports are relative to the importing file
+            for (auto&& import_path : m->ast->imports) {
+                auto child = fs::absolute(file_name.parent_path() / import_path).string();
+                m->children.push_back(child);
+                request(child);
+            }
+        } catch (...) {
+            m->error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        m->done = true;
+        pending--;
+        finished.notify_all();
+    }
+
+ public:
+    ModuleLoader(ThreadPool *pool, std::set<std::string> loaded,
+        std::map<std::string, std::pair<int64_t, std::unique_ptr<AST::Program>>> *spare) :
+        pool(pool), loaded(loaded), spare(spare) {}
+
+    // tasks still running refer to this loader
+    ~ModuleLoader() {
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [this] { return pending == 0; });
+    }
+
+    // schedules the module unless a module of that name is known already
+    void request(const std::string &path) {
+        auto name = module_name(fs::path(path));
+        Module *m;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if ((loaded.count(name) != 0) || (modules.count(name) != 0))
+                return;
+            auto owned = std::make_unique<Module>();
+            owned->path = path;
+            m = owned.get();
+            modules[name] = std::move(owned);
+            pending++;
+        }
+        pool->submit([this, m] { load(m); });
+    }
+
+    // waits for the module and takes over its tree
+    Module *get(const std::string &name) {
+        std::unique_lock<std::mutex> guard(lock);
+        auto m = modules[name].get();
+        finished.wait(guard, [m] { return m->done; });
+        if (m->error)
+            std::rethrow_exception(m->error);
+        return m;
+    }
+};
+
+}  // namespace
+
 void runtime_imports(std::vector<std::string> import_vector, AST::SymTable *st) {
-    std::vector<std::string> import_queue = import_vector; 
-    const auto c_path = fs::current_path();
+    static ThreadPool pool;
+    auto& imports = AST::Interpreter::current()->imports;
+    auto& module_tables = AST::Interpreter::current()->module_tables;
+    std::set<std::string> loaded;
+    for (auto&& it : imports)
+        loaded.insert(it.first);
+
+    ModuleLoader loader(&pool, loaded, &AST::Interpreter::current()->spare);
+    for (auto&& path : import_vector)
+        loader.request(path);
+
+    // declare in the order a serial breadth first walk would
+    std::vector<AST::Program *> declared;
+    std::deque<std::string> import_queue(import_vector.begin(), import_vector.end());
     while (!import_queue.empty()) {
-        // preprocess filenames
-        auto file_name = fs::path(*import_queue.begin());
-        auto base_name = file_name.filename().string();
-        base_name = base_name.substr(0, base_name.find_first_of("."));
-
-        import_queue.erase(import_queue.begin());
-        std::filebuf file;
-        if (!file.open(file_name, std::ios::in))
-            std::runtime_error("import(): " + file_name.relative_path().string() + " not found");
-        
-        auto it = imports.find(base_name);
-        if (it == imports.end()) {
+        auto base_name = module_name(fs::path(import_queue.front()));
+        import_queue.pop_front();
+
+        if (imports.find(base_name) == imports.end()) {
             // avoid recursive imports
+            auto m = loader.get(base_name);
             auto fnst = new AST::SymTable();
             fnst->addLayer();
-            auto sc = scanner(&file, file_name.filename().string());
-            auto ast = parse(sc);
-            sc.Free();
-            ast->declare(fnst);
-            auto this_path = file_name.parent_path();
-            fs::current_path(this_path);
-            for (auto import_path : ast->imports) {
-                // preprocess file directory
-                import_queue.push_back(fs::absolute(import_path).string());
-            }
-            fs::current_path(c_path);
+            m->ast->defer(fnst);
+            for (auto&& child : m->children)
+                import_queue.push_back(child);
 
             AST::TypeDecl clty = AST::TypeDecl(AST::Name("import"), 0);
-            st->insert(AST::Name(base_name), new AST::ValueType(fnst, &clty));
-            imports[base_name] = std::move(ast);
+            st->insert(AST::Name(base_name), new AST::ValueType(fnst, &clty, true));
+            module_tables[base_name] = fnst;
+            AST::Interpreter::current()->module_files[base_name] = {m->path, file_mtime(m->path)};
+            declared.push_back(m->ast.get());
+            imports[base_name] = std::move(m->ast);
         }
     }
+
+    // modules refer to each other in any order
+    for (auto&& prog : declared)
+        link_program(prog);
+}
+
+bool runtime_stale(const std::vector<std::string> &import_vector) {
+    auto& files = AST::Interpreter::current()->module_files;
+    for (auto&& path : import_vector) {
+        auto it = files.find(module_name(fs::path(path)));
+        if ((it != files.end()) && (it->second.first != path))
+            return true;
+    }
+    for (auto&& it : files)
+        if (file_mtime(it.second.first) != it.second.second)
+            return true;
+    return false;
+}
+
+AST::SymTable *runtime_module(const std::string &name) {
+    auto& module_tables = AST::Interpreter::current()->module_tables;
+    auto it = module_tables.find(name);
+    return (it == module_tables.end()) ? nullptr : it->second;
 }
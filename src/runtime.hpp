@@ -10,7 +10,19 @@
 
 #include "ast.hpp"
 
-extern AST::ValueType *runtime_handler(AST::Name fn, AST::FuncCall *call, AST::SymTable *st);
+extern AST::ValueType *runtime_builtin(int id, AST::FuncCall *call, AST::SymTable *st);
+extern AST::ValueType *runtime_construct(AST::ClassDecl *cl, AST::FuncCall *call, AST::SymTable *st);
 extern AST::ValueType *runtime_enum_handler(AST::ValueType *vt, AST::FuncCall *call, AST::SymTable *st);
 extern void runtime_bind(AST::SymTable *st);
+// the value leaves every variable holding it, as with =
+extern void runtime_take_over(AST::ValueType *vt);
+// the builtin never keeps a reference to its arguments
+extern bool runtime_read_only(const std::string &name);
+// the builtin changes nothing but its arguments
+extern bool runtime_local(const std::string &name);
 extern void runtime_imports(std::vector<std::string> imports, AST::SymTable *st);
+// an imported module changed on disk, or `imports` brings in another file
+// under the name of a loaded module
+extern bool runtime_stale(const std::vector<std::string> &imports);
+// symbol table of an imported module, nullptr if no module has that name
+extern AST::SymTable *runtime_module(const std::string &name);
@@ -5,50 +5,229 @@
 
 #include "scanner.hpp"
 
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <stdexcept>
 #include <iostream>
 
 #include "util.hpp"
 
+/**
+ * Keyword Recognition - a perfect hash over the keywords listed in TOKENS,
+ * searched for at compile time
+ */
+namespace {
+
+#define TOKEN_KEYWORD(tok, term, keyword) keyword,
+constexpr const char *keyword_spelling[] = {
+    TOKENS(TOKEN_KEYWORD)
+};
+#undef TOKEN_KEYWORD
+
+constexpr int token_count = sizeof(keyword_spelling) / sizeof(keyword_spelling[0]);
+constexpr int hash_bits = 6;
+
+constexpr size_t length_of(const char *s) {
+    size_t n = 0;
+    while (s[n] != '\0') n++;
+    return n;
+}
+
+// multiply-shift over first char, middle char, last char and length
+constexpr uint32_t keyword_hash(const char *s, size_t len, uint32_t seed) {
+    uint32_t key = (uint32_t)(uint8_t)s[0] |
+        ((uint32_t)(uint8_t)s[len / 2] << 8) |
+        ((uint32_t)(uint8_t)s[len - 1] << 16) |
+        ((uint32_t)len << 24);
+    return (key * seed) >> (32 - hash_bits);
+}
+
+struct KeywordTable {
+    uint32_t seed;
+    int8_t bucket[1 << hash_bits];  // token, or -1
+    uint8_t length[token_count];
+};
+
+constexpr KeywordTable make_keyword_table(void) {
+    for (uint32_t seed = 0x9E3779B1u; seed < 0x9E3779B1u + (1u << 20); seed += 2) {
+        KeywordTable t{seed, {}, {}};
+        for (auto& b : t.bucket) b = -1;
+        bool perfect = true;
+        for (int i = 0; (i < token_count) && perfect; ++i) {
+            if (keyword_spelling[i] == nullptr)
+                continue;
+            auto len = length_of(keyword_spelling[i]);
+            auto h = keyword_hash(keyword_spelling[i], len, seed);
+            if (t.bucket[h] != -1)
+                perfect = false;
+            t.bucket[h] = i;
+            t.length[i] = len;
+        }
+        if (perfect)
+            return t;
+    }
+    return KeywordTable{0, {}, {}};
+}
+
+constexpr KeywordTable keywords = make_keyword_table();
+static_assert(keywords.seed != 0, "no perfect hash for TOKENS keywords, widen hash_bits");
+
+token keyword(const char *s, size_t len) {
+    int b = keywords.bucket[keyword_hash(s, len, keywords.seed)];
+    if ((b < 0) || (keywords.length[b] != len) ||
+        (memcmp(s, keyword_spelling[b], len) != 0))
+        return t_name;
+    return static_cast<token>(b);
+}
+
+}  // namespace
+
+scanner::scanner(std::string path, std::string filename) :
+    scanner(sources.load(path, filename)) {}
+
+scanner::scanner(SourceFile *file) :
+    file(file), line_start(0), filename(file->filename), tok{t_eof, 0, 0}, row(0), col(0) {
+    buf = file->buf;
+    length = file->length;
+    cur = buf;
+    end = buf + length;
+    look = buf;
+    kernels = scan_kernels();
+}
+
+void scanner::Free(void) {
+    file->release();
+    buf = cur = end = look = nullptr;
+    length = 0;
+}
+
+std::string scanner::line(void) const {
+    const char *b = buf + line_start;
+    while ((b < end) && ((*b == ' ') || (*b == '\t'))) b++;
+    const char *e = b;
+    while ((e < end) && (*e != '\n') && (*e != '\r')) e++;
+    return std::string(b, e - b);
+}
+
 void scanner::next(void) {
-    if (!this->input->get(this->c)) {
+    if (cur == end) {
         this->c = '\0';
+        look = end;
         return;
     }
+    look = cur;
+    this->c = *cur++;
     if ((c == '\n') || (c == '\r')) {
-        this->line = "";
+        line_start = cur - buf;
         row++;
         col = 0;
     } else {
-        if ((this->line.size() != 0) || ((c != '\t') && (c != ' ')))
-            this->line += c;
         col++;
     }
 }
 
+// consumes the chars before p, which hold no line break unless `lines` is
+// set, and loads *p as the look ahead char
+void scanner::skip_to(const char *p, bool lines) {
+    if (lines) {
+        for (const char *q = cur; q < p; ++q) {
+            if ((*q == '\n') || (*q == '\r')) {
+                line_start = q + 1 - buf;
+                row++;
+                col = 0;
+            } else {
+                col++;
+            }
+        }
+    } else {
+        col += p - cur;
+    }
+    cur = p;
+    next();
+}
+
+// only strings, chars and comments can hide a brace, nothing is tokenized
+SourceLoc scanner::skip_block(int *block_row) {
+    // the look ahead char was already counted when it started a new line
+    *block_row = ((c == '\n') || (c == '\r')) ? row - 1 : row;
+    SourceLoc at = file->base + tok.offset;
+
+    const char *p = look;
+    int depth = 1;
+    while (p < end) {
+        switch (*p) {
+            case '{':
+                depth++;
+                break;
+            case '}':
+                depth--;
+                break;
+            case '"':
+                p = kernels->find_quote(p + 1, end);
+                while ((p + 1 < end) && (*p == '\\'))
+                    p = kernels->find_quote(p + 2, end);  // escape sequence
+                break;
+            case '\'':
+                p += (((p + 1 < end) && (p[1] == '\\')) ? 3 : 2);
+                break;
+            case '#':
+                p = kernels->find_newline(p, end) - 1;
+                break;
+            default:
+                break;
+        }
+        if ((depth == 0) || (p >= end))
+            break;
+        p++;
+    }
+    if (p >= end)
+        throw std::runtime_error("scanner: unterminated block");
+    if (p == look) {
+        next();  // empty block, the '}' is the look ahead char
+    } else {
+        skip_to(p, true);
+        next();
+    }
+    return at;
+}
+
+void scanner::seek(size_t offset, int at_row) {
+    const char *p = buf + offset;
+    const char *s = p;
+    while ((s > buf) && (s[-1] != '\n') && (s[-1] != '\r')) s--;
+    line_start = s - buf;
+    row = at_row;
+    col = p - s;
+    cur = p;
+    next();
+}
+
 token scanner::scan(void) {
-    this->data = "";
-    while (isspace(c) || (c == '\n') || (c == '\r')) next();
+    tok.kind = scan_token();
+    tok.length = (look - buf) - tok.offset;
+    return tok.kind;
+}
+
+token scanner::scan_token(void) {
+    if (is_space(c)) skip_to(kernels->skip_space(cur, end), true);
+    tok.offset = look - buf;
     switch (c) {
         case '\0': {
             return t_eof;
         }
         case '"': {
             // string
-            do {
-                data += c;
-                next();
-                if (c == '\\') {
-                    data += c;
-                    next();
-                    data += c;
-                    next();
-                }
-            } while (c != '"');
-            data += c;
-            next();
-
-            data = unescape(data);
+            const char *p = cur;
+            while (true) {
+                p = kernels->find_quote(p, end);
+                if ((p == end) || ((*p == '\\') && (p + 1 == end)))
+                    throw std::runtime_error("scanner: unterminated string literal");
+                if (*p == '"')
+                    break;
+                p += 2;  // escape sequence
+            }
+            skip_to(p + 1, true);
             return t_str;
         }
         case '\'': {
@@ -56,10 +235,7 @@ token scanner::scan(void) {
             next();
             if (c == '\\') {
                 next();
-                if (c == 'n') c = '\n';
-                if (c == 'r') c = '\r';
             }
-            data += c;
             next();
             if (c != '\'') {
                 throw std::runtime_error(
@@ -70,10 +246,8 @@ token scanner::scan(void) {
         }
         case '#': {
             // comment
-            while (c != '\n') {
-                next();
-            }
-            return scan();
+            skip_to(kernels->find_newline(cur, end), false);
+            return scan_token();
         }
         case '(': {
             next();
@@ -203,51 +377,24 @@ token scanner::scan(void) {
             return eol;
         }
         default: {
-            if (isdigit(c)) {
-                data += c;
+            if (is_digit(c)) {
+                const char *p = cur;
                 bool is_float = false;
-                next();
-                while (isdigit(c) || ((c == '.') && (!is_float))) {
-                    data += c;
-                    if (c == '.') is_float = true;
-                    next();
+                while ((p < end) && (is_digit(*p) || ((*p == '.') && (!is_float)))) {
+                    if (*p == '.') is_float = true;
+                    p++;
                 }
+                skip_to(p, false);
                 if (is_float)
                     return t_float;
                 else
                     return t_int;
             }
-            if (isalpha(c) || (c == '_')) {
-                data += c;
-                next();
-                while (isalpha(c) || isdigit(c) || (c == '_')) {
-                    data += c;
-                    next();
-                }
-                if (data == "import") return t_import;
-                if (data == "var") return t_var;
-                if (data == "const") return t_const;
-                if (data == "function") return t_fn;
-                if (data == "class") return t_class;
-                if (data == "enum") return t_enum;
-                if (data == "union") return t_union;
-                if (data == "if") return t_if;
-                if (data == "else") return t_else;
-                if (data == "match") return t_match;
-                if (data == "while") return t_while;
-                if (data == "for") return t_for;
-                if (data == "break") return t_break;
-                if (data == "continue") return t_continue;
-                if (data == "return") return t_return;
-                if (data == "void") return type_void;
-                if (data == "bool") return type_bool;
-                if (data == "int32") return type_int32;
-                if (data == "uint8") return type_uint8;
-                if (data == "char") return type_char;
-                if (data == "fp32") return type_fp32;
-                if (data == "fp64") return type_fp64;
-                if (data == "str") return type_str;
-                return t_name;
+            if (is_alpha(c)) {
+                const char *start = cur - 1;
+                const char *p = kernels->skip_ident(cur, end);
+                skip_to(p, false);
+                return keyword(start, p - start);
             }
             LogError("unknown character: '" << c << "'" << (int)c << ')');
             return t_eof;
@@ -5,59 +5,143 @@
 
 #pragma once
 
-#include <iostream>
-#include <fstream>
+#include <cstdint>
 #include <string>
+#include <string_view>
 
+#include "charclass.hpp"
+#include "source.hpp"
+
+// X(token, term, keyword): every token with its printable term and, for
+// keywords, the spelling the scanner recognizes (nullptr otherwise)
+#define TOKENS(X) \
+    X(t_str, "str", nullptr) \
+    X(t_char, "char", nullptr) \
+    X(t_float, "fp32", nullptr) \
+    X(t_int, "int32", nullptr) \
+    X(t_var, "var", "var") \
+    X(t_const, "const", "const") \
+    X(t_class, "class", "class") \
+    X(t_fn, "function", "function") \
+    X(t_union, "union", "union") \
+    X(t_enum, "enum", "enum") \
+    X(t_import, "import", "import") \
+    X(t_if, "if", "if") \
+    X(t_else, "else", "else") \
+    X(t_while, "while", "while") \
+    X(t_for, "for", "for") \
+    X(t_parallel, "parallel", "parallel") \
+    X(t_match, "match", "match") \
+    X(t_break, "break", "break") \
+    X(t_continue, "continue", "continue") \
+    X(t_return, "return", "return") \
+    X(t_yield, "yield", "yield") \
+    X(t_async, "async", "async") \
+    X(type_void, "type_void", "void") \
+    X(type_bool, "type_bool", "bool") \
+    X(type_char, "type_char", "char") \
+    X(type_int32, "type_int32", "int32") \
+    X(type_uint8, "type_uint8", "uint8") \
+    X(type_fp32, "type_fp32", "fp32") \
+    X(type_fp64, "type_fp64", "fp64") \
+    X(type_str, "type_str", "str") \
+    X(type_chan, "type_chan", "chan") \
+    X(type_future, "type_future", "future") \
+    X(type_generator, "type_generator", "generator") \
+    X(lpar, "(", nullptr) \
+    X(rpar, ")", nullptr) \
+    X(lbra, "{", nullptr) \
+    X(rbra, "}", nullptr) \
+    X(larr, "[", nullptr) \
+    X(rarr, "]", nullptr) \
+    X(equ, "==", nullptr) \
+    X(neq, "!=", nullptr) \
+    X(lor, "||", nullptr) \
+    X(land, "&&", nullptr) \
+    X(move, "=", nullptr) \
+    X(copy, ":=", nullptr) \
+    X(bor, "|", nullptr) \
+    X(band, "&", nullptr) \
+    X(bxor, "^", nullptr) \
+    X(gt, ">", nullptr) \
+    X(ge, ">=", nullptr) \
+    X(lt, "<", nullptr) \
+    X(le, "<=", nullptr) \
+    X(add, "+", nullptr) \
+    X(sub, "-", nullptr) \
+    X(mul, "*", nullptr) \
+    X(t_div, "/", nullptr) \
+    X(rem, "%", nullptr) \
+    X(colon, ":", nullptr) \
+    X(comma, ",", nullptr) \
+    X(eol, "EOL", nullptr) \
+    X(dot, ".", nullptr) \
+    X(t_name, "name", nullptr) \
+    X(gen, "`", nullptr) \
+    X(t_eof, "EOF", nullptr)
+
+#define TOKEN_ENUM(tok, term, keyword) tok,
 enum token {
-    t_str, t_char, t_float, t_int,
-    t_var, t_const, t_class, t_fn, t_union, t_enum, t_import,
-    t_if, t_else, t_while, t_for, t_match,
-    t_break, t_continue, t_return,
-    type_void, type_bool, type_char, type_int32, type_uint8, type_fp32, type_fp64, type_str,
-    lpar, rpar, lbra, rbra, larr, rarr, equ, neq, lor, land, move, copy,
-    bor, band, bxor, gt, ge, lt, le, add, sub, mul, t_div, rem,
-    colon, comma, eol,
-    dot, t_name, gen,
-    t_eof
+    TOKENS(TOKEN_ENUM)
 };
+#undef TOKEN_ENUM
 
+#define TOKEN_TERM(tok, term, keyword) term,
 const std::string terms[] = {
-    "str", "char", "fp32", "int32",
-    "var", "const", "class", "function", "union", "enum", "import",
-    "if", "else", "while", "for", "match",
-    "break", "continue", "return",
-    "type_void", "type_bool", "type_char", "type_int32", "type_uint8", "type_fp32", "type_fp64", "type_str",
-    "(", ")", "{", "}", "[", "]", "==", "!=", "||", "&&", "=", ":=",
-    "|", "&", "^", ">", ">=", "<", "<=", "+", "-", "*", "/", "%",
-    ":", ",", "EOL",
-    ".", "name", "`",
-    "EOF"
+    TOKENS(TOKEN_TERM)
+};
+#undef TOKEN_TERM
+
+// a token refers back into the source buffer instead of owning its text
+struct Token {
+    token kind;
+    uint32_t offset;
+    uint32_t length;
 };
 
 class scanner {
  private:
-    std::istream *input;
+    SourceFile *file;  // owned by the source registry
+    const char *buf;  // whole source
+    const char *cur;
+    const char *end;
+    const char *look;  // position of the look ahead char
+    size_t length;
+    size_t line_start;  // offset of the first char of the current line
+    const ScanKernels *kernels;
+
     void next(void);
+    void skip_to(const char *p, bool lines);
+    token scan_token(void);
  public:
     std::string filename;
-    std::string data;
-    std::string line;
+    Token tok;  // last scanned token
     int row, col;
 
     char c = ' ';  // current (look ahead) char
 
-    explicit scanner(std::filebuf *in, std::string filename) {
-        this->filename = filename;
-        input = new std::istream(in);
-        data = "";
-        line = "";
-        row = 0;
-        col = 0;
-    }
+    scanner(std::string path, std::string filename);
+    explicit scanner(SourceFile *file);
     token scan(void);
 
-    void Free(void) {
-        delete input;
+    // skips the block whose '{' was just scanned, up to its matching '}'.
+    // Gives the location and row of the '{' to seek() back to later.
+    SourceLoc skip_block(int *block_row);
+    // continues scanning at the given offset of the file, on the given row
+    void seek(size_t offset, int at_row);
+
+    // raw source text of the last scanned token, valid until Free()
+    std::string_view text(void) const {
+        return std::string_view(buf + tok.offset, tok.length);
     }
+
+    // text of the current line, only built when a diagnostic needs it
+    std::string line(void) const;
+
+    // location of the current position
+    SourceLoc loc(void) const {
+        return file->base + (cur - buf);
+    }
+
+    void Free(void);
 };
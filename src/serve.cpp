@@ -0,0 +1,212 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#include "serve.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <streambuf>
+
+#include "ast.hpp"
+#include "err.hpp"
+#include "cache.hpp"
+#include "pool.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// output of a script, sent as it is flushed
+class SocketBuf : public std::streambuf {
+ private:
+    int fd;
+    char buf[4096];
+
+    bool drain(void) {
+        const char *p = pbase();
+        while (p < pptr()) {
+            auto n = send(fd, p, pptr() - p, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                setp(buf, buf + sizeof(buf));
+                return false;  // client is gone, drop the rest
+            }
+            p += n;
+        }
+        setp(buf, buf + sizeof(buf));
+        return true;
+    }
+
+ protected:
+    int overflow(int c) override {
+        if (!drain())
+            return traits_type::eof();
+        if (c != traits_type::eof()) {
+            *pptr() = c;
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync(void) override {
+        return drain() ? 0 : -1;
+    }
+
+ public:
+    explicit SocketBuf(int fd) : fd(fd) {
+        setp(buf, buf + sizeof(buf));
+    }
+};
+
+class Request {
+ private:
+    int fd;
+    std::string pending;
+
+    bool fill(void) {
+        char chunk[4096];
+        ssize_t n;
+        while (((n = recv(fd, chunk, sizeof(chunk), 0)) < 0) && (errno == EINTR)) {}
+        if (n <= 0)
+            return false;
+        pending.append(chunk, n);
+        return true;
+    }
+
+    std::string line(void) {
+        size_t end;
+        while ((end = pending.find('\n')) == std::string::npos)
+            if (!fill())
+                throw std::runtime_error("serve: incomplete request");
+        auto l = pending.substr(0, end);
+        pending.erase(0, end + 1);
+        return l;
+    }
+
+ public:
+    fs::path cwd;
+    std::string path;  // empty for inline source
+    std::string source;
+
+    explicit Request(int fd) : fd(fd) {
+        while (true) {
+            auto l = line();
+            auto space = l.find(' ');
+            auto key = l.substr(0, space);
+            auto value = (space == std::string::npos) ? "" : l.substr(space + 1);
+            if (key == "cwd") {
+                cwd = fs::path(value);
+            } else if (key == "run") {
+                path = value;
+                return;
+            } else if (key == "inline") {
+                size_t n = std::stoul(value);
+                while (pending.size() < n)
+                    if (!fill())
+                        throw std::runtime_error("serve: incomplete request");
+                source = pending.substr(0, n);
+                return;
+            } else {
+                throw std::runtime_error("serve: unknown request " + key);
+            }
+        }
+    }
+};
+
+void handle(int fd) {
+    // imports stay declared for the next script on this thread
+    static thread_local AST::Interpreter warm;
+    warm.resident = true;
+
+    SocketBuf buf(fd);
+    std::ostream out(&buf);
+    try {
+        Request req(fd);
+        run_script(&warm, req.path, req.source, req.cwd, out);
+    } catch (std::exception &e) {
+        out << "Error: " << e.what() << std::endl;
+    }
+    out.flush();
+    close(fd);
+}
+
+}  // namespace
+
+int run_script(AST::Interpreter *in, const std::string &path, const std::string &source,
+    const fs::path &cwd, std::ostream &out) {
+    in->out = &out;
+    bool running = false;
+    int status = 0;
+    try {
+        std::unique_ptr<AST::Program> prog;
+        fs::path base = cwd;
+        if (path.empty()) {
+            prog = load_text(source, "<inline>");
+        } else {
+            auto file = fs::path(path);
+            if (file.is_relative())
+                file = cwd / file;
+            if (base.empty())
+                base = file.parent_path();
+            prog = load_program(file.string(), file.filename().string());
+        }
+        // imports of the script are relative to cwd, not to this process
+        for (auto&& import_path : prog->imports)
+            import_path = fs::absolute(base / import_path).lexically_normal().string();
+        running = true;
+        in->run(std::move(*prog));
+        running = false;
+    } catch (InterpreterException &e) {
+        out << e.describe();
+        status = 1;
+    } catch (std::exception &e) {
+        out << "Error: " << e.what() << std::endl;
+        status = 1;
+    }
+    if (running) {
+        // whatever the script left half declared goes with its modules
+        in->unload();
+    }
+    in->out = &std::cout;
+    return status;
+}
+
+int serve(const std::string &socket_path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("serve: socket path too long: " + socket_path);
+    std::strcpy(addr.sun_path, socket_path.c_str());
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+        throw std::runtime_error("serve: socket() error");
+    unlink(socket_path.c_str());
+    if (bind(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+        throw std::runtime_error("serve: bind() error: " + socket_path);
+    if (listen(sock, SOMAXCONN) != 0)
+        throw std::runtime_error("serve: listen() error: " + socket_path);
+
+    ThreadPool pool;
+    while (true) {
+        int fd = accept(sock, nullptr, nullptr);
+        if (fd < 0) {
+            if ((errno == EINTR) || (errno == ECONNABORTED))
+                continue;
+            throw std::runtime_error("serve: accept() error");
+        }
+        pool.submit([fd] { handle(fd); });
+    }
+    return 0;
+}
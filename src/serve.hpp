@@ -0,0 +1,35 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * warm interpreter daemon on a unix domain socket
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <ostream>
+#include <string>
+
+#include "ast.hpp"
+
+// Accepts scripts on the socket and runs them on a thread pool, until the
+// process is killed. Every worker thread keeps an interpreter whose
+// imported modules and builtins stay declared between scripts; all of them
+// are reloaded once a module file changes. Module variables therefore
+// keep their values from one script to the next.
+//
+// A request is a few header lines, the last one naming the script:
+//     cwd <dir>        optional, relative paths resolve against it
+//     run <path>       runs the file
+//     inline <n>       runs the n bytes of source that follow
+// The output of the script, and the error that stopped it, is streamed
+// back until the server closes the connection.
+extern int serve(const std::string &socket_path);
+
+// Runs the script at `path`, or the inline `source` when path is empty, on
+// an interpreter of the calling thread. Relative paths, and the imports of
+// the script, resolve against `cwd` (the script's directory if empty).
+// Output and errors go to `out`; returns 0 on success, 1 on error.
+extern int run_script(AST::Interpreter *in, const std::string &path, const std::string &source,
+    const std::filesystem::path &cwd, std::ostream &out);
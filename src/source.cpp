@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#include "source.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+SourceManager sources;
+
+SourceFile::~SourceFile() {
+    if (mapped)
+        munmap(const_cast<char *>(buf), length);
+}
+
+void SourceFile::release(void) {
+    // clean private pages are dropped and faulted back in from the file
+    // should a diagnostic need them
+    if (mapped)
+        madvise(const_cast<char *>(buf), length, MADV_DONTNEED);
+}
+
+SourceFile *SourceManager::load(std::string path, std::string filename) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("open() error: " + path);
+
+    auto file = std::make_unique<SourceFile>();
+    file->filename = filename;
+
+    struct stat sb;
+    if ((fstat(fd, &sb) == 0) && S_ISREG(sb.st_mode) && (sb.st_size > 0)) {
+        void *p = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, sb.st_size, MADV_SEQUENTIAL);
+            file->buf = static_cast<const char *>(p);
+            file->length = sb.st_size;
+            file->mapped = true;
+        }
+    }
+    if (!file->mapped) {
+        // pipes, empty files or mmap failure: read into a buffer instead
+        char chunk[65536];
+        ssize_t n;
+        while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+            file->contents.append(chunk, n);
+        file->buf = file->contents.data();
+        file->length = file->contents.size();
+    }
+    close(fd);
+    return insert(std::move(file), path);
+}
+
+SourceFile *SourceManager::add(std::string text, std::string filename) {
+    auto file = std::make_unique<SourceFile>();
+    file->filename = filename;
+    file->contents = std::move(text);
+    file->buf = file->contents.data();
+    file->length = file->contents.size();
+    return insert(std::move(file), filename);
+}
+
+SourceFile *SourceManager::insert(std::unique_ptr<SourceFile> file, const std::string &name) {
+    // one extra location for the end of file
+    std::lock_guard<std::mutex> guard(lock);
+    if (file->length + 1 > UINT32_MAX - next)
+        throw std::runtime_error("source locations exhausted: " + name);
+    file->base = next;
+    next += file->length + 1;
+
+    files.push_back(std::move(file));
+    return files.back().get();
+}
+
+SourceFile *SourceManager::find(SourceLoc loc) const {
+    auto it = std::upper_bound(files.begin(), files.end(), loc,
+        [](SourceLoc l, const std::unique_ptr<SourceFile> &f) { return l < f->base; });
+    if ((loc == 0) || (it == files.begin()))
+        return nullptr;
+    return (--it)->get();
+}
+
+SourceFile *SourceManager::file(SourceLoc loc) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return find(loc);
+}
+
+// row and col follow the scanner: every '\n' or '\r' starts a new row, col
+// counts the chars consumed on the current one
+SourceInfo SourceManager::resolve(SourceLoc loc) const {
+    SourceInfo info;
+    std::lock_guard<std::mutex> guard(lock);
+    auto file = find(loc);
+    if (file == nullptr)
+        return info;
+    size_t off = std::min<size_t>(loc - file->base, file->length);
+
+    size_t line_start = 0;
+    for (size_t i = 0; i < off; ++i) {
+        if ((file->buf[i] == '\n') || (file->buf[i] == '\r')) {
+            line_start = i + 1;
+            info.row++;
+        }
+    }
+    info.filename = file->filename;
+    info.col = off - line_start;
+
+    const char *b = file->buf + line_start;
+    const char *end = file->buf + file->length;
+    while ((b < end) && ((*b == ' ') || (*b == '\t'))) b++;
+    const char *e = b;
+    while ((e < end) && (*e != '\n') && (*e != '\r')) e++;
+    info.line = std::string(b, e - b);
+    return info;
+}
@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * registry of loaded source files and compact source locations
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Every loaded file is laid out after the previous one in a single 32-bit
+// space, so a location is just base of the file + byte offset. 0 marks an
+// unknown location.
+typedef uint32_t SourceLoc;
+
+class SourceFile {
+ public:
+    std::string filename;
+    SourceLoc base = 0;
+    const char *buf = nullptr;
+    size_t length = 0;
+    bool mapped = false;
+    std::string contents;  // storage when the file could not be mapped
+
+    SourceFile() {}
+    SourceFile(const SourceFile &) = delete;
+    SourceFile& operator= (const SourceFile &) = delete;
+    ~SourceFile();
+
+    // the scanner is done, the text is only kept around for diagnostics
+    void release(void);
+};
+
+// a location expanded for printing
+struct SourceInfo {
+    std::string filename;
+    int row = 0;
+    int col = 0;
+    std::string line;
+};
+
+class SourceManager {
+ private:
+    std::vector<std::unique_ptr<SourceFile>> files;  // ordered by base
+    SourceLoc next = 1;
+    mutable std::mutex lock;  // files are loaded from several threads
+
+    SourceFile *find(SourceLoc loc) const;
+    SourceFile *insert(std::unique_ptr<SourceFile> file, const std::string &name);
+
+ public:
+    // maps (or reads) the file and reserves its range of locations
+    SourceFile *load(std::string path, std::string filename);
+    // source text that has no file, e.g. sent to a server
+    SourceFile *add(std::string text, std::string filename);
+    SourceInfo resolve(SourceLoc loc) const;
+    // the file a location lies in, nullptr for unknown locations
+    SourceFile *file(SourceLoc loc) const;
+};
+
+extern SourceManager sources;
@@ -0,0 +1,258 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#include "task.hpp"
+
+#include <deque>
+#include <memory>
+#include <thread>
+
+#include "ast.hpp"
+#include "pool.hpp"
+
+namespace {
+
+// tasks queued by one thread: it takes the newest, thieves the oldest
+class Queue {
+ private:
+    std::mutex lock;
+    std::deque<Task *> tasks;
+
+ public:
+    void push(Task *t) {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.push_back(t);
+    }
+
+    Task *pop(void) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (tasks.empty())
+            return nullptr;
+        auto t = tasks.back();
+        tasks.pop_back();
+        return t;
+    }
+
+    Task *steal(void) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (tasks.empty())
+            return nullptr;
+        auto t = tasks.front();
+        tasks.pop_front();
+        return t;
+    }
+};
+
+// the queue of the worker running on this thread
+thread_local Queue *own = nullptr;
+
+// Workers start as tasks are queued, up to the wanted number running at
+// once; one blocked on another thread does not count, so more may start.
+class Scheduler {
+ private:
+    static const size_t max_workers = 1024;
+
+    size_t wanted;
+    Queue outside;  // queued by threads that are not workers
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> started{0};
+    std::atomic<size_t> blocked{0};
+    std::atomic<size_t> idle{0};
+    std::atomic<size_t> queued{0};
+
+    std::mutex lock;
+    std::condition_variable ready;
+    bool stopping = false;
+
+    // with `lock` held
+    void start(void) {
+        auto p = workers.size();
+        if (p == max_workers)
+            return;
+        queues[p] = std::make_unique<Queue>();
+        started = p + 1;
+        workers.emplace_back([this, p] { work(p); });
+    }
+
+    Task *find(size_t p) {
+        auto t = queues[p]->pop();
+        if (t == nullptr)
+            t = outside.steal();
+        size_t n = started;
+        for (size_t i = 1; (t == nullptr) && (i < n); ++i)
+            t = queues[(p + i) % n]->steal();
+        if (t != nullptr)
+            queued--;
+        return t;
+    }
+
+    void work(size_t p) {
+        own = queues[p].get();
+        while (true) {
+            if (auto t = find(p)) {
+                t->run();
+                t->release();
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(lock);
+            if (stopping)
+                return;
+            idle++;
+            ready.wait(guard, [this] { return stopping || (queued > 0); });
+            idle--;
+        }
+    }
+
+ public:
+    Scheduler() : wanted(pool_threads()), queues(max_workers) {}
+
+    ~Scheduler() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto&& w : workers)
+            w.join();
+    }
+
+    void submit(Task *t) {
+        if (own != nullptr)
+            own->push(t);
+        else
+            outside.push(t);
+        queued++;
+        if (idle > 0) {
+            std::lock_guard<std::mutex> guard(lock);
+            ready.notify_one();
+        } else if (started - blocked < wanted) {
+            std::lock_guard<std::mutex> guard(lock);
+            if ((idle == 0) && (started - blocked < wanted))
+                start();
+            else
+                ready.notify_one();
+        }
+    }
+
+    // the newest task the calling worker queued, if it is one
+    Task *pop_own(void) {
+        if (own == nullptr)
+            return nullptr;
+        auto t = own->pop();
+        if (t != nullptr)
+            queued--;
+        return t;
+    }
+
+    void block(void) {
+        std::lock_guard<std::mutex> guard(lock);
+        blocked++;
+        if (queued == 0)
+            return;
+        if (idle > 0)
+            ready.notify_one();
+        else if (started - blocked < wanted)
+            start();
+    }
+
+    void unblock(void) {
+        blocked--;
+    }
+};
+
+Scheduler &scheduler(void) {
+    static Scheduler s;
+    return s;
+}
+
+}  // namespace
+
+Task::Task(AST::Interpreter *top, AST::FuncDecl *fd, std::vector<AST::ValueType *> args) :
+    top(top), fd(fd), args(std::move(args)) {}
+
+Task::Task(AST::Interpreter *top) : state(running), top(top), fd(nullptr) {}
+
+Task::~Task() {
+    for (auto&& vt : args)
+        if (vt->ms.size() == 0)
+            delete vt;
+    if ((result != nullptr) && (result != & AST::None))
+        delete result;
+}
+
+void Task::release(void) {
+    if (--refs == 0)
+        delete this;
+}
+
+bool Task::run(void) {
+    int expected = pending;
+    if (!state.compare_exchange_strong(expected, running))
+        return false;
+    AST::ValueType *vt = nullptr;
+    std::exception_ptr e;
+    try {
+        vt = top->execute(fd, std::move(args));
+    } catch (...) {
+        e = std::current_exception();
+    }
+    args.clear();
+    complete(vt, e);
+    // the program may be unloaded from here on
+    top->finish(e);
+    return true;
+}
+
+void Task::complete(AST::ValueType *vt, std::exception_ptr e) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        result = vt;
+        error = e;
+        state = done;
+    }
+    finished.notify_all();
+}
+
+void Task::wait(void) {
+    // tasks queued after this one are most likely what it waits for
+    while (state != done) {
+        auto t = scheduler().pop_own();
+        if (t == nullptr)
+            break;
+        t->run();
+        t->release();
+    }
+    if (state == done)
+        return;
+    Blocking blocking;
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [this] { return state == done; });
+}
+
+AST::ValueType *Task::await(void) {
+    if (!run())
+        wait();
+    std::lock_guard<std::mutex> guard(lock);
+    if (error)
+        std::rethrow_exception(error);
+    auto vt = result;
+    result = nullptr;
+    return vt;
+}
+
+void Task::submit(Task *t) {
+    scheduler().submit(t->share());
+}
+
+Blocking::Blocking() : worker(own != nullptr) {
+    if (worker)
+        scheduler().block();
+}
+
+Blocking::~Blocking() {
+    if (worker)
+        scheduler().unblock();
+}
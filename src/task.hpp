@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * spawned and async calls and their futures, on a work-stealing scheduler
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+namespace AST {
+class ValueType;
+class FuncDecl;
+class Interpreter;
+}
+
+// A call of a function of the program, run by whichever thread gets to it
+// first: a worker of the scheduler, or the one waiting for its result. Or
+// an async call, which its coroutine completes. Shared by every future
+// holding it; the last one to let go deletes it with the result nobody
+// took.
+class Task {
+ private:
+    enum { pending, running, done };
+    std::atomic<int> state{pending};
+    std::atomic<int> refs{1};
+
+    AST::Interpreter *top;
+    AST::FuncDecl *fd;
+    std::vector<AST::ValueType *> args;
+    AST::ValueType *result = nullptr;
+    std::exception_ptr error;
+    std::mutex lock;
+    std::condition_variable finished;
+
+    void wait(void);
+
+ public:
+    // takes over the arguments
+    Task(AST::Interpreter *top, AST::FuncDecl *fd, std::vector<AST::ValueType *> args);
+    // an async call, running already
+    explicit Task(AST::Interpreter *top);
+    Task(const Task &) = delete;
+    Task& operator= (const Task &) = delete;
+    ~Task();
+
+    Task *share(void) {
+        refs++;
+        return this;
+    }
+    void release(void);
+
+    // runs the call on the calling thread, false if a thread already did
+    bool run(void);
+    // the call returned `vt`, or threw `error`
+    void complete(AST::ValueType *vt, std::exception_ptr error);
+    bool ended(void) const { return state == done; }
+    // Waits for the result, and hands it over: nullptr once taken. If no
+    // thread started the call yet it runs here, otherwise the calling
+    // thread runs the tasks it queued meanwhile. Throws what the call threw.
+    AST::ValueType *await(void);
+
+    // Queues the task for the scheduler, which holds a share of it until
+    // it ran. A worker takes the tasks it queued itself newest first, and
+    // steals the oldest of others once it runs out. YC_THREADS sets how
+    // many workers run at once, one per hardware thread otherwise.
+    static void submit(Task *t);
+};
+
+// Marks the calling thread as waiting on other threads for its lifetime.
+// A worker of the scheduler has another thread take its place meanwhile,
+// so that what it waits for is not stuck behind it.
+class Blocking {
+ private:
+    bool worker;
+
+ public:
+    Blocking();
+    ~Blocking();
+};
@@ -3,70 +3,71 @@
  * All rights reserved.
  */
 
-#include <sstream>
 #include <iostream>
 #include <vector>
 
 #include "util.hpp"
 
-std::string unescape(std::string raw) {
+std::string unescape(std::string_view raw) {
     raw = raw.substr(1, raw.size() - 2);
 
-    std::ostringstream ss;
+    // the result is never longer than the literal
+    std::string out;
+    out.reserve(raw.size());
 
-    unsigned int i = 0;
+    size_t i = 0;
     while (i < raw.size()) {
         if (raw[i] != '\\') {
-            ss << raw[i];
+            out += raw[i];
         } else {
             if ((i + 1) == raw.size()) {
                 std::cerr << "Parser: invalid string literal" << std::endl;
-                return raw;
+                return std::string(raw);
             }
 
             switch (raw[i+1]) {
                 case 'a': {
-                    ss << '\a';
+                    out += '\a';
                     break;
                 }
                 case 'b': {
-                    ss << '\b';
+                    out += '\b';
                     break;
                 }
                 case 't': {
-                    ss << '\t';
+                    out += '\t';
                     break;
                 }
                 case 'n': {
-                    ss << '\n';
+                    out += '\n';
                     break;
                 }
                 case 'v': {
-                    ss << '\v';
+                    out += '\v';
                     break;
                 }
                 case 'f': {
-                    ss << '\f';
+                    out += '\f';
                     break;
                 }
                 case 'r': {
-                    ss << '\r';
+                    out += '\r';
                     break;
                 }
                 case '"': {
-                    ss << '\"';
+                    out += '\"';
                     break;
                 }
                 case '\'': {
-                    ss << '\'';
+                    out += '\'';
                     break;
                 }
                 case '\?': {
-                    ss << '\?';
+                    out += '\?';
                     break;
                 }
                 case '\\': {
-                    ss << '\\';
+                    out += '\\';
                     break;
                 }
                 default: {
@@ -79,5 +80,5 @@ std::string unescape(std::string raw) {
         i++;
     }
 
-    return ss.str();
+    return out;
 }
@@ -6,11 +6,13 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <memory>
 
 #include "ast.hpp"
 
-extern std::string unescape(std::string raw);
+// strips the quotes of a string or char literal and decodes its escapes
+extern std::string unescape(std::string_view raw);
 
 // type cast unique pointers
 template<typename TO, typename FROM>
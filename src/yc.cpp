@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ */
+
+#include "yc.hpp"
+
+#include <filesystem>
+#include <stdexcept>
+
+#include "ast.hpp"
+#include "err.hpp"
+#include "cache.hpp"
+
+namespace fs = std::filesystem;
+
+namespace yc {
+
+static AST::ValueType *to_value(const Value &v) {
+    switch (v.kind) {
+        case Value::Bool:
+            return new AST::ValueType(v.b, false);
+        case Value::Char:
+            return new AST::ValueType(v.c, false);
+        case Value::UInt8:
+            return new AST::ValueType(v.u8, false);
+        case Value::Int32:
+            return new AST::ValueType(static_cast<int>(v.i), false);
+        case Value::FP32:
+            return new AST::ValueType(v.f, false);
+        case Value::FP64:
+            return new AST::ValueType(v.d, false);
+        case Value::Str:
+            return new AST::ValueType(new std::string(v.s), false);
+        default:
+            throw std::runtime_error("void cannot be passed to a script");
+    }
+}
+
+static Value from_value(AST::ValueType *vt) {
+    if (vt->type.arrayT != 0)
+        throw std::runtime_error("cannot return " + vt->type.str() + " to the host");
+    switch (vt->type.baseType) {
+        case AST::t_void:
+            return Value();
+        case AST::t_bool:
+            return Value(vt->data.one_bit);
+        case AST::t_char:
+            return Value(vt->data.cval);
+        case AST::t_uint8:
+            return Value(vt->data.bval);
+        case AST::t_int32:
+            return Value(static_cast<int32_t>(vt->data.ival));
+        case AST::t_fp32:
+            return Value(vt->data.fval);
+        case AST::t_fp64:
+            return Value(vt->data.dval);
+        case AST::t_str:
+            return Value(*vt->data.str);
+        default:
+            throw std::runtime_error("cannot return " + vt->type.str() + " to the host");
+    }
+}
+
+Script::Script(const std::string &path) : interpreter(std::make_unique<AST::Interpreter>()) {
+    auto file = fs::path(path);
+    auto prog = load_program(file.string(), file.filename().string());
+    try {
+        interpreter->load(std::move(*prog));
+    } catch (InterpreterException &e) {
+        throw std::runtime_error(e.describe());
+    }
+}
+
+Script::~Script() {}
+
+int Script::run(void) {
+    call("main");
+    return 0;
+}
+
+Value Script::call(const std::string &function, const std::vector<Value> &args) {
+    std::vector<AST::ValueType *> pars;
+    try {
+        for (auto&& v : args)
+            pars.push_back(to_value(v));
+    } catch (...) {
+        for (auto&& vt : pars)
+            delete vt;
+        throw;
+    }
+
+    AST::ValueType *ret;
+    try {
+        ret = interpreter->call(function, pars);
+    } catch (InterpreterException &e) {
+        throw std::runtime_error(e.describe());
+    }
+    bool owned = (ret->ms.size() == 0) && (ret != & AST::None);
+    Value result;
+    try {
+        result = from_value(ret);
+    } catch (...) {
+        if (owned)
+            delete ret;
+        throw;
+    }
+    if (owned)
+        delete ret;
+    return result;
+}
+
+}  // namespace yc
@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2020 by Yudi Yang <2000jedi@gmail.com>.
+ * All rights reserved.
+ * -------------------
+ * embedding interface of libyc
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace AST {
+class Interpreter;
+}
+
+namespace yc {
+
+// a value passed to or returned from a script
+class Value {
+ public:
+    enum Kind { Void, Bool, Char, UInt8, Int32, FP32, FP64, Str };
+    Kind kind = Void;
+    union {
+        bool b;
+        char c;
+        uint8_t u8;
+        int32_t i;
+        float f;
+        double d;
+    };
+    std::string s;
+
+    Value() : i(0) {}
+    Value(bool v) : kind(Bool), b(v) {}
+    Value(char v) : kind(Char), c(v) {}
+    Value(uint8_t v) : kind(UInt8), u8(v) {}
+    Value(int32_t v) : kind(Int32), i(v) {}
+    Value(float v) : kind(FP32), f(v) {}
+    Value(double v) : kind(FP64), d(v) {}
+    Value(std::string v) : kind(Str), i(0), s(v) {}
+    Value(const char *v) : kind(Str), i(0), s(v) {}
+};
+
+// A program parsed and declared once. Its functions can then be called any
+// number of times; global variables keep their values between calls. A
+// script is used by one thread at a time, separate scripts run in parallel.
+// Errors are thrown as std::runtime_error.
+class Script {
+ private:
+    std::unique_ptr<AST::Interpreter> interpreter;
+
+ public:
+    explicit Script(const std::string &path);
+    Script(const Script &) = delete;
+    Script& operator= (const Script &) = delete;
+    ~Script();
+
+    // runs main()
+    int run(void);
+    // calls a function by name, `mod.name` for one of an imported module
+    Value call(const std::string &function, const std::vector<Value> &args = {});
+};
+
+}  // namespace yc